@@ -0,0 +1,468 @@
+/** @file bench.cpp
+ *  @brief Contains main() of BioSimBench, the benchmarks of the Simulation core.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *
+ *  Synopsis:
+ *  @code
+ *  # BioSimBench [-t threads] [-y years] [-s scale] [directory] > bench.json
+ *  @endcode
+ *  The directory holds the files of the test_1 example: Bjarnoya.geo, cell.spec, bytte_1.par, rovdyr_1.par and test_1.pop.
+ *  The map and its population are tiled up to @c scale times in each direction, into a scratch directory removed afterwards.
+ *  Microbenchmarks time single functions on the untiled map, and the population files on the largest one; macrobenchmarks
+ *  time @c years whole years of each tiled map with @c threads threads. The results are written to standard output as JSON;
+ *  each has a @c name, a @c unit counted, the @c count done in @c seconds, and @c rate, the count per second. For the
+ *  macrobenchmarks, the unit is animal-updates: one Animal taken through one year.
+ */
+
+#include "prefix.h"
+#include "BioSim.h"
+#include "random.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <memory>
+#include <exception>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+/// @brief The least time a microbenchmark is repeated for, in seconds.
+#ifndef BENCH_SECONDS
+#define BENCH_SECONDS 0.25
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+/// @brief The outcome of one benchmark.
+struct Result {
+  std::string name;  ///< @brief The name of the benchmark.
+  std::string unit;  ///< @brief What is counted.
+  double count;      ///< @brief The number done.
+  double seconds;    ///< @brief The time taken.
+  std::vector<std::pair<std::string, double> > extra; ///< @brief Further numbers describing the run.
+};
+
+static volatile double sink; ///< @brief Receives results, so that timed work is not optimized away.
+
+/// @return The seconds since @c start.
+static double since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/** The body is run with 1, 2, 4... repetitions until a run takes at least BENCH_SECONDS; that run is reported.
+ *  @param name The name of the benchmark.
+ *  @param unit What is counted.
+ *  @param body Called with a number of repetitions; returns the count done.
+ */
+template <class Body> static Result measure(const std::string &name, const std::string &unit, Body body) {
+  Result result = {name, unit, 0, 0, std::vector<std::pair<std::string, double> >()};
+  for (size_t reps = 1; ; reps *= 2) {
+    Clock::time_point start = Clock::now();
+    result.count = body(reps);
+    result.seconds = since(start);
+    if (result.seconds >= BENCH_SECONDS) return result;
+  }
+}
+
+/// @return @c text as a JSON string.
+static std::string quote(const std::string &text) {
+  std::string retval = "\"";
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '"' || text[i] == '\\') retval += '\\';
+    retval += text[i];
+  }
+  return retval + "\"";
+}
+
+/// @brief Sends a stream to another one while in scope, even if an exception is thrown.
+struct Redirect {
+  std::ostream &stream;  ///< @brief The redirected stream.
+  std::streambuf *saved; ///< @brief Its own buffer, restored on destruction.
+  Redirect(std::ostream &from, std::ostream &to) : stream(from), saved(from.rdbuf(to.rdbuf())) {} ///< @brief Redirects @c from to @c to.
+  ~Redirect() { stream.rdbuf(saved); } ///< @brief Restores the stream.
+};
+
+/** @brief A Map and its Animals, without a Simulation around them.
+ *
+ *  Gives the microbenchmarks access to the parts that a Simulation keeps to itself.
+ */
+struct World {
+  BioSim::Map map;           ///< @brief The Map.
+  BioSim::AnimalStore store; ///< @brief The Animals.
+  BioSim::Species prey;      ///< @brief The herbivores.
+  BioSim::Species pred;      ///< @brief The predators.
+  /** @param dir The directory of the example files.
+   *  @param geo The .geo file.
+   *  @param pop The population to insert.
+   */
+  World(const std::string &dir, const std::string &geo, const BioSim::Population &pop) {
+    map.initSpec(dir + "/cell.spec");
+    map.init(geo);
+    store.geography(&map);
+    map.population(&store);
+    prey.init(dir + "/bytte_1.par");
+    pred.init(dir + "/rovdyr_1.par");
+    store.addSpecies(&prey);
+    store.addSpecies(&pred);
+    for (size_t b = 0; b < pop.blocks.size(); b++) {
+      const BioSim::PopulationBlock &block = pop.blocks[b];
+      BioSim::Species *genus = pop.genera[block.genus] == prey.genus() ? &prey : &pred;
+      BioSim::Cell *locus = map.at(block.x, block.y);
+      for (uint32_t i = 0; i < block.count && locus && locus->addAnimal(); i++) {
+        const BioSim::PopulationRecord &record = pop.records[block.first + i];
+        BioSim::Animal beast(&store, store.create(store.speciesId(genus), record.alder, record.vekt));
+        beast.moveTo(locus);
+      }
+    }
+  }
+};
+
+/** @param geo   The .geo file to tile.
+ *  @param scale The number of copies in each direction.
+ *  @param path  The tiled .geo file to write.
+ *  @param rows  Set to the number of rows of the untiled map.
+ *  @param cols  Set to the number of columns of the untiled map.
+ */
+static void tileGeography(const std::string &geo, unsigned int scale, const std::string &path, unsigned int &rows, unsigned int &cols) {
+  std::ifstream is(geo.c_str());
+  if (!is) throw std::runtime_error("could not open " + geo);
+  std::vector<std::string> lines;
+  std::string line;
+  rows = cols = 0;
+  while (std::getline(is, line)) {
+    std::istringstream words(line);
+    std::string word;
+    if (!(words >> word) || word[0] == COMMENT_CHAR) continue;
+    if (word == "Rader") words >> rows;
+    else if (word == "Kolonner") words >> cols;
+    else lines.push_back(word);
+  }
+  if (!rows || !cols || lines.size() != rows) throw std::runtime_error("could not tile " + geo);
+  std::ofstream os(path.c_str());
+  os << "Rader     " << rows * scale << std::endl << "Kolonner  " << cols * scale << std::endl << std::endl;
+  for (unsigned int ty = 0; ty < scale; ty++) {
+    for (unsigned int r = 0; r < rows; r++) {
+      for (unsigned int tx = 0; tx < scale; tx++) os << lines[r];
+      os << std::endl;
+    }
+  }
+  if (!os) throw std::runtime_error("could not write " + path);
+}
+
+/** @param base  The population of the untiled map.
+ *  @param scale The number of copies in each direction.
+ *  @param rows  The number of rows of the untiled map.
+ *  @param cols  The number of columns of the untiled map.
+ *  @param geo   The name of the tiled .geo file.
+ *  @return A copy of the population in each tile.
+ */
+static BioSim::Population tilePopulation(const BioSim::Population &base, unsigned int scale, unsigned int rows, unsigned int cols, const std::string &geo) {
+  BioSim::Population tiled;
+  tiled.geography = geo;
+  tiled.genera = base.genera;
+  for (unsigned int ty = 0; ty < scale; ty++) {
+    for (unsigned int tx = 0; tx < scale; tx++) {
+      for (size_t b = 0; b < base.blocks.size(); b++) {
+        BioSim::PopulationBlock block = base.blocks[b];
+        block.x += tx * cols;
+        block.y += ty * rows;
+        block.first = tiled.records.size();
+        tiled.blocks.push_back(block);
+        tiled.records.insert(tiled.records.end(), base.records.begin() + base.blocks[b].first,
+                             base.records.begin() + base.blocks[b].first + block.count);
+      }
+    }
+  }
+  return tiled;
+}
+
+/** @param world The untiled World.
+ *  @param results Receives the results.
+ */
+static void microKernels(World &world, std::vector<Result> &results) {
+  std::vector<double> vekt;
+  std::vector<double> alder;
+  for (BioSim::AnimalHandle beast = 0; beast < world.store.slots() && vekt.size() < 1024; beast++) {
+    if (world.store.genus(beast) != 0) continue;
+    vekt.push_back(world.store.vekt(beast));
+    alder.push_back(world.store.alder(beast));
+  }
+  size_t n = vekt.size();
+  results.push_back(measure("Species::fitness", "calls", [&](size_t reps) {
+    double sum = 0;
+    for (size_t r = 0; r < reps; r++) {
+      for (size_t i = 0; i < n; i++) sum += world.prey.fitness(vekt[i], (int) alder[i]);
+    }
+    sink = sum;
+    return (double) (reps * n);
+  }));
+  std::vector<double> phi(n);
+  results.push_back(measure("BioSim::fitness/batch", "animals", [&](size_t reps) {
+    for (size_t r = 0; r < reps; r++) BioSim::fitness(world.prey.curve(), vekt.data(), alder.data(), phi.data(), n);
+    sink = phi[0];
+    return (double) (reps * n);
+  }));
+
+  toolbox::RandomGenerator rng(55);
+  results.push_back(measure("RandomStream::drand", "draws", [&](size_t reps) {
+    toolbox::RandomStream stream = rng.stream(0, 0);
+    double sum = 0;
+    for (size_t r = 0; r < reps * 4096; r++) sum += stream.drand();
+    sink = sum;
+    return (double) (reps * 4096);
+  }));
+  results.push_back(measure("RandomStream::nrand", "draws", [&](size_t reps) {
+    toolbox::RandomStream stream = rng.stream(0, 0);
+    unsigned long sum = 0;
+    for (size_t r = 0; r < reps * 4096; r++) sum += stream.nrand(1000);
+    sink = sum;
+    return (double) (reps * 4096);
+  }));
+  results.push_back(measure("RandomGenerator::drand", "draws", [&](size_t reps) {
+    double sum = 0;
+    for (size_t r = 0; r < reps * 4096; r++) sum += rng.drand(0, r, 0);
+    sink = sum;
+    return (double) (reps * 4096);
+  }));
+
+  BioSim::Cell *crowded = NULL;
+  BioSim::CellRange live = world.map.mapView();
+  for (BioSim::CellRange::iterator it = live.begin(); it != live.end(); ++it) {
+    if (!crowded || (*it)->headcount() > crowded->headcount()) crowded = *it;
+  }
+  if (crowded) {
+    Result result = measure("Cell::cellMates", "calls", [&](size_t reps) {
+      size_t sum = 0;
+      for (size_t r = 0; r < reps; r++) sum += crowded->cellMates(&world.prey).size();
+      sink = sum;
+      return (double) reps;
+    });
+    result.extra.push_back(std::make_pair("animals", (double) crowded->headcount(world.store.speciesId(&world.prey))));
+    results.push_back(result);
+  }
+
+  unsigned int rows = world.map.rows();
+  unsigned int cols = world.map.cols();
+  results.push_back(measure("Map::at", "lookups", [&](size_t reps) {
+    size_t hits = 0;
+    for (size_t r = 0; r < reps; r++) {
+      for (unsigned int y = 0; y <= rows; y++) {
+        for (unsigned int x = 0; x <= cols; x++) hits += world.map.at(x, y) != NULL;
+      }
+    }
+    sink = hits;
+    return (double) (reps * (rows + 1) * (cols + 1));
+  }));
+}
+
+/** @param dir     The directory of the example files.
+ *  @param scratch The scratch directory.
+ *  @param geo     The tiled .geo file.
+ *  @param tiled   The tiled population.
+ *  @param results Receives the results.
+ */
+static void microFiles(const std::string &dir, const std::string &scratch, const std::string &geo, const BioSim::Population &tiled, std::vector<Result> &results) {
+  double animals = tiled.records.size();
+  std::string text = scratch + "/bench.pop";
+  std::string binary = scratch + "/bench.bpop";
+  results.push_back(measure("Population::writeText", "animals", [&](size_t reps) {
+    for (size_t r = 0; r < reps; r++) tiled.writeText(text);
+    return reps * animals;
+  }));
+  results.push_back(measure("Population::writeBinary", "animals", [&](size_t reps) {
+    for (size_t r = 0; r < reps; r++) tiled.writeBinary(binary);
+    return reps * animals;
+  }));
+  results.push_back(measure("Population::readText", "animals", [&](size_t reps) {
+    for (size_t r = 0; r < reps; r++) {
+      BioSim::Population population;
+      population.readText(text);
+    }
+    return reps * animals;
+  }));
+  results.push_back(measure("Population::readBinary", "animals", [&](size_t reps) {
+    for (size_t r = 0; r < reps; r++) {
+      BioSim::Population population;
+      population.readBinary(binary);
+    }
+    return reps * animals;
+  }));
+  const char *formats[] = {"pop", "bpop"};
+  const std::string *paths[] = {&text, &binary};
+  for (int f = 0; f < 2; f++) {
+    Result result = {"Simulation::readPopulation/" + std::string(formats[f]), "animals", 0, 0, std::vector<std::pair<std::string, double> >()};
+    for (size_t reps = 1; result.seconds < BENCH_SECONDS; reps *= 2) { // A fresh Simulation for each read, set up untimed.
+      result.count = result.seconds = 0;
+      for (size_t r = 0; r < reps; r++) {
+        BioSim::Simulation core;
+        core.initGeoSpec(dir + "/cell.spec", geo);
+        core.initSpecies(dir + "/bytte_1.par");
+        core.initSpecies(dir + "/rovdyr_1.par");
+        Clock::time_point start = Clock::now();
+        if (!core.readPopulation(*paths[f])) throw std::runtime_error("could not read " + *paths[f]);
+        result.seconds += since(start);
+        result.count += animals;
+      }
+    }
+    results.push_back(result);
+  }
+
+#ifdef BIOSIM_PNG
+  World world(dir, geo, tiled);
+  std::vector<png_byte> snapshot = world.map.snapshotImage();
+  const char *profiles[] = {"rask", "balansert", "arkiv"};
+  double cells = world.map.size();
+  for (int p = 0; p < 3; p++) {
+    BioSim::PngProfile profile = BioSim::pngProfile(profiles[p]);
+    std::string png = scratch + "/bench.png";
+    results.push_back(measure("Map::writeImage/" + std::string(profiles[p]), "cells", [&](size_t reps) {
+      for (size_t r = 0; r < reps; r++) {
+        if (!world.map.writeImage(png, snapshot, profile)) throw std::runtime_error("could not write " + png);
+      }
+      return reps * cells;
+    }));
+  }
+#endif
+}
+
+/** @param dir     The directory of the example files.
+ *  @param scratch The scratch directory.
+ *  @param scale   The number of copies of the map in each direction.
+ *  @param geo     The tiled .geo file.
+ *  @param bpop    The tiled .bpop file.
+ *  @param threads The number of threads.
+ *  @param years   The number of years to time.
+ *  @return The result.
+ */
+static Result macroStep(const std::string &dir, const std::string &scratch, unsigned int scale, const std::string &geo, const std::string &bpop, int threads, int years) {
+  std::ostringstream name;
+  name << scratch << "/scale" << scale << ".sim";
+  std::ofstream sim(name.str().c_str());
+  sim << "Geografi        " << geo << std::endl
+      << "CelleSpec       " << dir << "/cell.spec" << std::endl
+      << "BytteParameter  " << dir << "/bytte_1.par" << std::endl
+      << "RovdyrParameter " << dir << "/rovdyr_1.par" << std::endl
+      << "Populasjon      " << bpop << std::endl
+      << "StartAar        0" << std::endl
+      << "SluttAar        " << years << std::endl
+      << "SlumptallFroe   55" << std::endl
+      << "UtdataStamme    " << scratch << "/scale" << scale << std::endl;
+  sim.close();
+
+  BioSim::Simulation core;
+  core.threadCount(threads);
+  core.init(name.str());
+  std::ostringstream label;
+  label << "Simulation::step/x" << scale;
+  Result result = {label.str(), "animal-updates", 0, 0, std::vector<std::pair<std::string, double> >()};
+  std::ostringstream console; // The yearly console line of the Simulation is not wanted among the JSON.
+  Redirect quiet(std::cout, console);
+  double first = 0;
+  for (int year = 0; year < years; year++) {
+    Clock::time_point start = Clock::now();
+    unsigned int stepped = core.advance();
+    result.seconds += since(start);
+    result.count += stepped;
+    if (!year) first = stepped;
+  }
+  result.extra.push_back(std::make_pair("scale", (double) scale));
+  result.extra.push_back(std::make_pair("years", (double) years));
+  result.extra.push_back(std::make_pair("threads", (double) threads));
+  result.extra.push_back(std::make_pair("animals", first));
+  return result;
+}
+
+/** @brief Runs the benchmarks and writes the results as JSON. */
+int main(int argc, char * const argv[]) {
+  std::string dir = "test_1";
+  int threads = 1;
+  int years = 10;
+  unsigned int maxScale = 4;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "-t" && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (arg == "-y" && i + 1 < argc) {
+      years = atoi(argv[++i]);
+    } else if (arg == "-s" && i + 1 < argc) {
+      maxScale = atoi(argv[++i]);
+    } else if (arg[0] != '-') {
+      dir = arg;
+    } else {
+      threads = 0;
+      break;
+    }
+  }
+  if (threads < 1 || years < 1 || maxScale < 1) {
+    std::cerr << "Usage: BioSimBench [-t threads] [-y years] [-s scale] [directory]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  char scratchName[] = "/tmp/BioSimBench.XXXXXX";
+  if (!mkdtemp(scratchName)) {
+    std::cerr << "Error: could not create a scratch directory." << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string scratch(scratchName);
+  std::vector<Result> results;
+  int retval = EXIT_SUCCESS;
+  try {
+    BioSim::Population base;
+    base.readText(dir + "/test_1.pop");
+    std::vector<std::string> geos;
+    std::vector<std::string> bpops;
+    BioSim::Population tiled;
+    for (unsigned int scale = 1; scale <= maxScale; scale *= 2) {
+      std::ostringstream stem;
+      stem << scratch << "/scale" << scale;
+      unsigned int rows, cols;
+      tileGeography(dir + "/Bjarnoya.geo", scale, stem.str() + ".geo", rows, cols);
+      tiled = tilePopulation(base, scale, rows, cols, stem.str() + ".geo");
+      tiled.writeBinary(stem.str() + ".bpop");
+      geos.push_back(stem.str() + ".geo");
+      bpops.push_back(stem.str() + ".bpop");
+    }
+
+    World world(dir, geos[0], tilePopulation(base, 1, 0, 0, geos[0]));
+    microKernels(world, results);
+    microFiles(dir, scratch, geos.back(), tiled, results);
+    for (size_t s = 0; s < geos.size(); s++) results.push_back(macroStep(dir, scratch, 1 << s, geos[s], bpops[s], threads, years));
+  } catch (std::exception &e) { // Whatever went wrong, the scratch directory is removed and the results so far written.
+    std::cerr << "Error: " << e.what() << std::endl;
+    retval = EXIT_FAILURE;
+  }
+  std::string clean = "rm -rf '" + scratch + "'";
+  if (system(clean.c_str())) std::cerr << "Warning: could not remove " << scratch << std::endl;
+
+  std::time_t now = std::time(NULL);
+  char date[32];
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+  std::cout << "{" << std::endl
+            << "  \"date\": " << quote(date) << "," << std::endl
+#ifdef __VERSION__
+            << "  \"compiler\": " << quote(__VERSION__) << "," << std::endl
+#endif
+#ifdef BIOSIM_CFLAGS
+            << "  \"flags\": " << quote(BIOSIM_CFLAGS) << "," << std::endl
+#endif
+            << "  \"threads\": " << threads << "," << std::endl
+            << "  \"results\": [" << std::endl;
+  std::cout << std::setprecision(6);
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    std::cout << "    {\"name\": " << quote(r.name) << ", \"unit\": " << quote(r.unit) << ", \"count\": " << std::fixed
+              << std::setprecision(0) << r.count << std::defaultfloat << std::setprecision(6) << ", \"seconds\": " << r.seconds
+              << ", \"rate\": " << (r.seconds > 0 ? r.count / r.seconds : 0);
+    for (size_t e = 0; e < r.extra.size(); e++) std::cout << ", " << quote(r.extra[e].first) << ": " << r.extra[e].second;
+    std::cout << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+  }
+  std::cout << "  ]" << std::endl << "}" << std::endl;
+  return retval;
+}
@@ -14,8 +14,12 @@
 #endif
 
 #include <vector>
+#include <iterator>
 #include "read_parameters.h"
-#include <set>
+#include "AnimalStore.h"
+#include "Span.h"
+#include "random.h"
+#include "Fitness.h"
 
 namespace BioSim {
   /** @brief Core fitness function.
@@ -48,61 +52,114 @@ namespace BioSim {
     double _F;            ///< @brief Herbivory species food desire.
     double _DeltaPhiMax;  ///< @brief Predatory species ∆Φ<sub>max</sub>.
     bool predatory;       ///< @brief Indicates predatoritivity.
+    FitnessCurve _curve;  ///< @brief Species fitness parameters, gathered for BioSim::fitness().
     toolbox::ReadParameters param_reader_;  ///< @brief Parameter reader.
+    void shape();                           ///< @brief Sets up the fitness parameters from the Species parameters.
   public:
     Species();                              ///< @brief Constructor.
     ~Species();                             ///< @brief Destructor.
     double deltaPhiMax();                   ///< @brief Returns ∆Φ<sub>max</sub>.
     void init(const std::string &params);   ///< @brief Initializes species.
+    bool parameter(const std::string &key, double value); ///< @brief Changes one parameter, by its .par keyword.
+    std::ostream &write(std::ostream &os);  ///< @brief Writes the Species parameters in binary form.
+    std::istream &read(std::istream &is);   ///< @brief Reads Species parameters written by write().
     double fitness(double weight, int age); ///< @brief Calculates fitness.
+    const FitnessCurve &curve() { return _curve; } ///< @brief Returns the fitness parameters.
+    double tabulate(double tolerance);      ///< @brief Tabulates the weight factors of the fitness function.
+    unsigned int weightPoints();            ///< @brief Returns the size of the weight table.
+    double deviation();                     ///< @brief Returns the largest error of the fitness tables.
     bool canBreed(double weight);           ///< @brief Determines breedabilty.
     double birthloss();                     ///< @brief Calulates birthloss of weight.
     double birthweight();                   ///< @brief Returns birthweight.
     double weightloss(double weight);       ///< @brief Calculates yearly weightloss.
-    double birthChance(Animal*beast,int largeN); ///< @brief Calculates the chance of breeding.
-    std::vector<Animal*> feed(Animal *beast); ///< @brief Performs feeding related activites.
+    double birthChance(Animal beast,int largeN); ///< @brief Calculates the chance of breeding.
+    std::vector<Animal> feed(Animal beast); ///< @brief Performs feeding related activites.
+    void feed(Animal beast, std::vector<Animal> &food); ///< @brief Performs feeding related activites, reusing a result buffer.
+    void hunt(Animal beast, std::vector<Animal> &prey, size_t &weakest, std::vector<Animal> &food); ///< @brief Lets a predator hunt herbivores sorted by fitness.
     std::string genus();                    ///< @brief Returns name of species.
     bool predator();                        ///< @brief Returns true for predatory species
-    bool die(double beastPhi);              ///< @brief Determines death or no death. @note Should be named death()?
-    bool willWander(double beastPhi);       ///< @brief Determines whether Animal will wander.
+    bool die(double beastPhi, double draw);                             ///< @brief Determines death or no death. @note Should be named death()?
+    bool willWander(double beastPhi, toolbox::RandomStream &rng);       ///< @brief Determines whether Animal will wander.
   };
 
   /** @brief Describes individual animals.
+   *
+   *  An Animal is a light-weight reference to a slot in an AnimalStore; the Animal data itself lives in the store columns.
+   *  Copying an Animal copies the reference, not the Animal.
    *  @ingroup BioSim
    */
   class Animal {
-    Species *isa;    ///< @brief A pointer to the Species.
-    double _vekt;    ///< @brief The weight of the Animal.
-    int _alder;      ///< @brief The age of the Animal.
-    Cell* _loci;     ///< @brief A pointer to the Cell containing the Animal
-    double _fitness; ///< @brief fitness() cache value.
+    AnimalStore *store; ///< @brief A pointer to the AnimalStore holding the Animal data.
+    AnimalHandle id;    ///< @brief The slot of the Animal in the store.
   public:
     Animal(); ///< @brief Creates a new zombie animal.
-    Animal(Species *type, Cell *location); ///< @brief "Births" an animal in a location.
-    Animal(Species *type, int alder, double vekt, Cell *location); ///< @brief Revivifies a preexisting animal
-    ~Animal();                      ///< @brief Destructs animal.
-    bool eat(Animal* prey);         ///< @brief Causes animal to attempt to eat.
-    Animal *breed();                ///< @brief Causes animal to attempt breeding.
+    Animal(AnimalStore *store, AnimalHandle id); ///< @brief Refers to the Animal in slot id of store.
+    AnimalHandle handle() { return id; } ///< @brief Returns the slot of the Animal in its store.
+    bool valid();                   ///< @brief Returns true unless the Animal is a zombie or has been destroyed.
+    bool eat(Animal prey);          ///< @brief Causes animal to attempt to eat.
+    bool conceive();                ///< @brief Performs the parent's part of breeding.
     Cell* location();               ///< @brief Returns a pointer to current Animal location.
-    std::vector<Animal*> feed();    ///< @brief Causes animal to feed.
+    std::vector<Animal> feed();     ///< @brief Causes animal to feed.
+    void feed(std::vector<Animal> &food); ///< @brief Causes animal to feed, reusing a result buffer.
     void adjust(int alder, double vekt); ///< @brief Adjusts animal.
     void fatten(double delta_w);    ///< @brief Fattens animal.
-    void age();                     ///< @brief Ages animal and related tasks.
     int alder();                    ///< @brief Returns Animal age. @todo Rename?
     bool moveTo(Cell* destination); ///< @brief Moves Animal to destination Cell
     double fitness();               ///< @brief Computes and returns Animal fitness.
     double weight();                ///< @brief Returns the Animal weight.
+    void kill();                    ///< @brief Marks the Animal as eaten, leaving it in its Cell.
+    bool dead() { return store->vekt(id) == 0; } ///< @brief Returns true if the Animal has been marked by kill().
     bool operator< (Animal &b);     ///< @brief Compares animals irt. fitness.
     bool operator> (Animal &b);     ///< @brief Compares animals irt. fitness.
-    bool die();                     ///< @brief Evaluates animal death and performs related tasks. @note death() would be better name.
+    bool operator== (const Animal &b) const { return store == b.store && id == b.id; } ///< @brief Compares animals irt. identity.
     Species *genus();               ///< @brief Returns a pointer to the Species of the Animal.
-    bool wander();       ///< @brief Wanders animal.
+    unsigned short genusId();       ///< @brief Returns the species id of the Animal in its store.
+  };
+
+  /** @brief A view of Animals, given as a Span of handles into an AnimalStore.
+   *
+   *  Iterating an AnimalRange yields Animal objects made on the fly from the handles; nothing is allocated or copied.
+   *  Like any Span, an AnimalRange of the inhabitants of a Cell is invalidated when Animals enter or leave that Cell.
+   *  @ingroup BioSim
+   */
+  class AnimalRange {
+    AnimalStore *store;                ///< @brief The store holding the Animals.
+    Span<const AnimalHandle> _handles; ///< @brief The handles of the Animals.
+  public:
+    /// @brief Forward iterator over an AnimalRange.
+    class iterator {
+      AnimalStore *store;        ///< @brief The store holding the Animals.
+      const AnimalHandle *pos;   ///< @brief The current handle.
+    public:
+      typedef std::forward_iterator_tag iterator_category; ///< @brief Iterator traits.
+      typedef Animal value_type;        ///< @brief Iterator traits.
+      typedef std::ptrdiff_t difference_type; ///< @brief Iterator traits.
+      typedef Animal* pointer;          ///< @brief Iterator traits.
+      typedef Animal reference;         ///< @brief Iterator traits; elements are returned by value.
+      iterator() : store(NULL), pos(NULL) {} ///< @brief Creates a singular iterator.
+      iterator(AnimalStore *store, const AnimalHandle *pos) : store(store), pos(pos) {} ///< @brief Creates an iterator.
+      Animal operator* () const { return Animal(store, *pos); }          ///< @brief Returns the current Animal.
+      iterator &operator++ () { ++pos; return *this; }                  ///< @brief Advances the iterator.
+      iterator operator++ (int) { iterator old = *this; ++pos; return old; } ///< @brief Advances the iterator.
+      bool operator== (const iterator &b) const { return pos == b.pos; } ///< @brief Compares iterators.
+      bool operator!= (const iterator &b) const { return pos != b.pos; } ///< @brief Compares iterators.
+    };
+    AnimalRange() : store(NULL) {}     ///< @brief Creates an empty range.
+    AnimalRange(AnimalStore *store, Span<const AnimalHandle> handles) : store(store), _handles(handles) {} ///< @brief Creates a range.
+    iterator begin() const { return iterator(store, _handles.begin()); } ///< @brief Returns an iterator to the first Animal.
+    iterator end() const { return iterator(store, _handles.end()); }     ///< @brief Returns an iterator past the last Animal.
+    size_t size() const { return _handles.size(); }                      ///< @brief Returns the number of Animals.
+    bool empty() const { return _handles.empty(); }                      ///< @brief Returns true if there are no Animals.
+    Animal operator[] (size_t i) const { return Animal(store, _handles[i]); } ///< @brief Returns Animal number i.
+    Span<const AnimalHandle> handles() const { return _handles; }        ///< @brief Returns the underlying handles.
   };
 
   /** @brief Helper operator for report writing.
    *  @ingroup BioSim
    */
-  std::ostream& operator<< (std::ostream& os, const std::vector<Animal *> &beasts);
-  bool p_fit(Animal*a,Animal*b);
-  bool part_pred(Animal *o);
+  std::ostream& operator<< (std::ostream& os, const std::vector<Animal> &beasts);
+  std::ostream& operator<< (std::ostream& os, const AnimalRange &beasts); ///< @brief Helper operator for report writing. @ingroup BioSim
+  bool p_fit(Animal a,Animal b);
+  bool p_unfit(Animal a,Animal b);
+  bool part_pred(Animal o);
 }
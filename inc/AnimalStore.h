@@ -0,0 +1,108 @@
+/** @file AnimalStore.h
+ *  @brief This file contains the AnimalStore class, which holds the data of all Animals in a Simulation.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#ifndef ANIMALSTORE_H
+#define ANIMALSTORE_H
+
+#include "prefix.h"
+#include "Arena.h"
+#include <vector>
+#include <istream>
+#include <ostream>
+
+/// @brief Denotes an invalid AnimalHandle.
+#ifndef ANIMAL_NONE
+#define ANIMAL_NONE 0xFFFFFFFFu
+#endif
+
+/// @brief Marks an unused slot in the species column of an AnimalStore.
+#ifndef SPECIES_NONE
+#define SPECIES_NONE 0xFFFF
+#endif
+
+/// @brief Denotes an Animal that is not located in any Cell.
+#ifndef CELL_NONE
+#define CELL_NONE 0xFFFFFFFFu
+#endif
+
+namespace BioSim {
+
+  class Species;
+  class Map;
+
+  /** @brief Identifies an Animal as a slot in an AnimalStore.
+   *  @ingroup BioSim
+   */
+  typedef unsigned int AnimalHandle;
+
+  /** @brief Holds the data of all Animals in a Simulation as parallel columns.
+   *
+   *  Every Animal occupies one slot, addressed by an AnimalHandle, and its species id, age, weight, cached fitness, Cell index
+   *  and place among the inhabitants of its Cell are stored at that position in separate contiguous arrays. Phases of the Simulation that touch every Animal can therefore
+   *  run as linear sweeps from 0 to slots(), skipping the slots for which valid() is false.
+   *
+   *  The columns are carved out of a single Arena, so births and deaths never go through the general purpose allocator.
+   *  Slots freed by destroy() form a free list threaded through the Cell index column and are reused last in, first out,
+   *  which keeps recently touched memory hot. When the Arena is full it is replaced by one of twice the capacity.
+   *  clear() and the destructor release all Animals at once by unmapping the Arena.
+   *
+   *  Fitness is cached per Animal and computed on demand by Animal::fitness(). Simulation::ageTile() and Simulation::feedTile()
+   *  instead call refreshFitness() on each species bucket they are about to read, which computes its stale values at once with
+   *  the vectorized BioSim::fitness() kernel, so that the loop that follows only reads the cache.
+   *  @ingroup BioSim
+   */
+  class AnimalStore {
+    Arena _arena;                         ///< @brief Memory holding all columns.
+    unsigned short *_genus;               ///< @brief Species id column. Free slots hold SPECIES_NONE.
+    int *_alder;                          ///< @brief Age column.
+    double *_vekt;                        ///< @brief Weight column.
+    double *_fitness;                     ///< @brief Fitness cache column.
+    unsigned int *_loci;                  ///< @brief Cell index column. For free slots, the next free slot.
+    unsigned int *_place;                 ///< @brief Column of positions within the Cell's species bucket.
+    unsigned int _slots;                  ///< @brief Number of slots in use or on the free list.
+    unsigned int _capacity;               ///< @brief Number of slots the Arena has room for.
+    AnimalHandle _free;                   ///< @brief Most recently freed slot, or ANIMAL_NONE.
+    bool _hugePages;                      ///< @brief Indicates that the Arena should be backed by huge pages.
+    std::vector<Species*> _species;       ///< @brief Species table, indexed by species id.
+    Map *_geography;                      ///< @brief The Map used to resolve Cell indices.
+    unsigned int _count;                  ///< @brief Number of live Animals.
+    void grow(unsigned int capacity);     ///< @brief Moves the columns to a larger Arena.
+    AnimalStore(const AnimalStore&);            ///< @brief Stores can not be copied.
+    AnimalStore& operator=(const AnimalStore&); ///< @brief Stores can not be copied.
+  public:
+    AnimalStore();                                  ///< @brief Creates an empty store.
+    void hugePages(bool enable);                    ///< @brief Requests huge pages for the columns from the next allocation on.
+    void reserve(unsigned int capacity);            ///< @brief Makes room for at least @c capacity slots.
+    void clear();                                   ///< @brief Destroys all Animals at once.
+    void geography(Map *map);                       ///< @brief Sets the Map used to resolve Cell indices.
+    Map *geography() { return _geography; }         ///< @brief Returns the Map used to resolve Cell indices.
+    unsigned short addSpecies(Species *genus);      ///< @brief Registers a Species and returns its id.
+    Species *species(unsigned short id) { return _species[id]; } ///< @brief Returns the Species with id.
+    unsigned short speciesId(Species *genus);       ///< @brief Returns the id of a registered Species.
+    unsigned short speciesCount() { return _species.size(); }    ///< @brief Returns the number of registered Species.
+    AnimalHandle create(unsigned short genus, int alder, double vekt); ///< @brief Creates an Animal outside of any Cell.
+    void allocate(size_t n, AnimalHandle *beasts);  ///< @brief Takes n slots at once, for emplace().
+    void emplace(AnimalHandle beast, unsigned short genus, int alder, double vekt); ///< @brief Creates an Animal outside of any Cell in a slot from allocate().
+    void destroy(AnimalHandle beast);               ///< @brief Removes an Animal from its Cell and releases its slot.
+    std::ostream &write(std::ostream &os);          ///< @brief Writes every slot in binary form.
+    std::istream &read(std::istream &is);           ///< @brief Replaces every slot by those written by write().
+    void forgetFitness(unsigned short genus);       ///< @brief Marks the fitness of every Animal of a species id stale.
+    unsigned int refreshFitness(unsigned short genus, const AnimalHandle *beasts, size_t n, std::vector<double> &scratch); ///< @brief Computes the stale fitness values of some Animals of one species.
+    bool valid(AnimalHandle beast) { return beast < _slots && _genus[beast] != SPECIES_NONE; } ///< @brief Returns true if beast is a live Animal.
+    unsigned int size() { return _count; }          ///< @brief Returns the number of live Animals.
+    unsigned int slots() { return _slots; }         ///< @brief Returns the number of slots; all handles are below this value.
+    unsigned short &genus(AnimalHandle beast) { return _genus[beast]; }  ///< @brief Species id of beast.
+    int &alder(AnimalHandle beast) { return _alder[beast]; }             ///< @brief Age of beast.
+    double &vekt(AnimalHandle beast) { return _vekt[beast]; }            ///< @brief Weight of beast.
+    double &fitness(AnimalHandle beast) { return _fitness[beast]; }      ///< @brief Cached fitness of beast, or ANIMAL_INV.
+    unsigned int &loci(AnimalHandle beast) { return _loci[beast]; }      ///< @brief Cell index of beast, or CELL_NONE.
+    unsigned int &place(AnimalHandle beast) { return _place[beast]; }    ///< @brief Position of beast among its species in its Cell. Maintained by Cell.
+  };
+}
+
+#endif //ANIMALSTORE_H
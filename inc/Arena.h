@@ -0,0 +1,41 @@
+/** @file Arena.h
+ *  @brief This file contains the Arena class, a page-mapped memory region for bulk Simulation data.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "prefix.h"
+#include <cstddef>
+
+namespace BioSim {
+
+  /** @brief A single anonymous memory mapping, released as a whole.
+   *
+   *  Memory is obtained directly from the operating system with mmap(), so it is zero-filled, page-aligned and only
+   *  backed by physical memory as it is touched. An Arena may optionally be backed by huge pages: explicit huge pages
+   *  are tried first, and if none are available the kernel is advised to use transparent huge pages for the region.
+   *  Destroying or reset()ting an Arena unmaps the whole region in one call, regardless of what was stored in it.
+   *  @ingroup BioSim
+   */
+  class Arena {
+    void *_base;      ///< @brief Start of the mapping, or @c NULL.
+    size_t _size;     ///< @brief Size of the mapping in bytes.
+    Arena(const Arena&);            ///< @brief Arenas can not be copied.
+    Arena& operator=(const Arena&); ///< @brief Arenas can not be copied.
+  public:
+    Arena();                                   ///< @brief Creates an empty Arena.
+    Arena(size_t bytes, bool hugePages=false); ///< @brief Creates an Arena of at least @c bytes bytes.
+    ~Arena();                                  ///< @brief Unmaps the Arena.
+    void reset();                              ///< @brief Unmaps the Arena, leaving it empty.
+    void swap(Arena &other);                   ///< @brief Exchanges the mappings of two Arenas.
+    char *base() { return (char*)_base; }      ///< @brief Returns the start of the Arena.
+    size_t size() { return _size; }            ///< @brief Returns the size of the Arena in bytes.
+  };
+}
+
+#endif //ARENA_H
@@ -9,9 +9,13 @@
 #include "prefix.h"
 #include "Animal.h"
 #include "Map.h"
+#include "AnimalStore.h"
+#include "ThreadPool.h"
+#include "Population.h"
+#include "ReportWriter.h"
 #include <iostream>
 #include <fstream>
-#include <set>
+#include "random.h"
 
 /** @defgroup BioSim BioSim Simulation core.
  *  Contains all the BioSim Simulation core functionality.
@@ -25,13 +29,69 @@
  */
 
 namespace BioSim {
+  /** @brief The steps of a Simulation year that draw random numbers.
+   *
+   *  Each step draws from its own random streams, one per Animal handle or Cell index, so that no step depends on the order in
+   *  which Animals or Cells are visited by another.
+   *  @ingroup BioSim
+   */
+  enum RandomPhase {
+    PHASE_DEATH,    ///< @brief Death, one stream per Animal handle.
+    PHASE_WANDER,   ///< @brief Wandering, one stream per Cell index.
+    PHASE_BREED,    ///< @brief Breeding, one stream per Cell index.
+    PHASE_FEED      ///< @brief Predation, one stream per Cell index.
+  };
+
+  /** @brief Scratch space of one thread of a Simulation step.
+   *
+   *  Every thread of the ThreadPool has its own StepBuffers, so that a step allocates nothing once the buffers have grown.
+   *  @ingroup BioSim
+   */
+  struct StepBuffers {
+    std::vector<Animal> order;        ///< @brief The Animals of the current Cell in feeding order.
+    std::vector<Animal> food;         ///< @brief The result of the current Animal's feeding.
+    std::vector<Animal> hunted;       ///< @brief The herbivores of the current Cell from the least to the most fit, for sorted hunting.
+    std::vector<AnimalHandle> dead;   ///< @brief Animals that died or were eaten, to be destroyed after the phase.
+    std::vector<double> batch;        ///< @brief Scratch space for batch fitness computation.
+    std::vector<double> uniform;      ///< @brief Random numbers for the Animals of the current Bucket.
+    std::vector<unsigned char> doomed; ///< @brief Death flags for the Animals of the current Bucket.
+    std::vector<int> census;          ///< @brief Change to Simulation::census from the Animals that died.
+    int prey;                         ///< @brief Net number of prey that fed.
+    int pred;                         ///< @brief Number of predators that fed.
+  };
+
+  /// @brief An Animal bound for another Cell.
+  struct Migrant {
+    AnimalHandle beast;   ///< @brief The Animal.
+    unsigned int cell;    ///< @brief Index of the destination Cell.
+  };
+
+  /// @brief A newborn Animal that is yet to be created.
+  struct Birth {
+    unsigned int cell;    ///< @brief Index of the Cell of the parent.
+    unsigned short genus; ///< @brief Species id of the newborn.
+  };
+
+  /** @brief The effects of one tile of a Simulation step on the rest of the Map.
+   *
+   *  They are collected while the tiles are processed in parallel, and applied afterwards in tile order.
+   *  @ingroup BioSim
+   */
+  struct TileBuffers {
+    std::vector<Migrant> migrants;         ///< @brief Animals wandering out of the Cells of the tile.
+    std::vector<Migrant> arrivals;         ///< @brief Animals wandering into the Cells of the tile.
+    std::vector<Birth> births;             ///< @brief Newborns of the tile.
+    std::vector<unsigned short> litter;    ///< @brief Newborns of the current Cell.
+    std::vector<int> census;               ///< @brief Change to Simulation::census from Animals that wandered or were born.
+  };
+
   /** @brief Wrapper class for simulations.
    *  @ingroup BioSim
    */
   class Simulation {
     Map geography;              ///< @brief The simulation geography.
     std::list<Species> species; ///< @brief A list of the Species in the Simulation.
-    std::set<Animal *> animals;  ///< @brief A list of the Animals in the Simulation.
+    AnimalStore animals;        ///< @brief The Animals in the Simulation.
     int _year;              ///< @brief The current Simulation year.
     std::string _cells;     ///< @brief The pathname for the ArchCell.par file.
     std::string _cellSpec;  ///< @brief The pathname for an ArchCell.spec file.
@@ -41,20 +101,63 @@ namespace BioSim {
     int year_begin;       ///< @brief The beginning year.
     int year_end;         ///< @brief The end year.
     int randseed;         ///< @brief The random seed.
+    toolbox::RandomGenerator rng; ///< @brief The random generator, addressed by year, BioSim::RandomPhase and Animal or Cell.
     std::string dumpsite; ///< @brief The filename base for output files.
     int inter_animal;     ///< @brief The interval for .dyr file dumps.
     int inter_feed;       ///< @brief The interval for feed file dumps.
     int inter_pop;        ///< @brief The interval for population file dumps.
     int inter_png;        ///< @brief THe interval for visual report dumps.
+    int inter_chk;        ///< @brief The interval for checkpoints.
+    int compress_chk;     ///< @brief Indicates that checkpoints should be compressed.
+    std::string _resume;  ///< @brief The pathname of a checkpoint to resume from; empty for a fresh start.
+    int huge_pages;       ///< @brief Indicates that Animal data should be backed by huge pages.
+    int threads;          ///< @brief The number of threads used for a step.
+    int thread_override;  ///< @brief The number of threads given on the command line; 0 if none.
+    double fitness_tolerance; ///< @brief The largest error allowed in tabulated fitness; 0 for exact fitness.
+    int fitness_check;    ///< @brief Indicates that the error of the fitness tables should be reported.
+    int sorted_hunt;      ///< @brief Indicates that predators hunt the herbivores of a Cell in order of fitness.
+    int report_threads;   ///< @brief The number of threads writing reports; 0 to write them between steps.
+    std::string png_profile_name; ///< @brief The name of the PNG encoding profile.
+    int png_threads;      ///< @brief The number of threads compressing each PNG report.
+#ifdef BIOSIM_PNG
+    PngProfile png_profile; ///< @brief The PNG encoding profile.
+#endif
+    ThreadPool pool;                       ///< @brief The threads running the steps.
+    std::vector<StepBuffers> workers;      ///< @brief Scratch space for each thread of the pool.
+    std::vector<TileBuffers> tiles;        ///< @brief Cross-tile effects of each tile of the Map.
+    std::vector<Species*> allSpecies;      ///< @brief The Species, by species id.
+    std::vector<AnimalHandle> newborns;    ///< @brief Handles for the newborns of all Cells, in Cell index order.
+    std::vector<unsigned int> litters;     ///< @brief The number of newborns of each Cell, by index.
+    std::vector<unsigned int> firstborn;   ///< @brief The position in @c newborns of the first newborn of each Cell, by index.
+    std::vector<long> census;              ///< @brief The number of Animals of each species id on each terrain type; see censusOf().
+    std::vector<int> columns;              ///< @brief The terrain type of each pair of .dat columns; -1 for a classic type the Map lacks.
+    std::string columnNames;               ///< @brief The name of the terrain type of each pair of .dat columns.
     std::list<std::string> populae;        ///< @brief A list of file paths for Animal.pop files.
     std::list<std::string> genera;         ///< @brief A list of file paths for Species.par files.
     toolbox::ReadParameters param_reader_; ///< @brief The parameter reader.
     std::ofstream report_dat;              ///< @brief The stream to use for .dat writing.
+    ReportWriter reports;                  ///< @brief The threads writing the other reports; destroyed, and so drained, before the Map.
     void step(); ///< @brief Causes the Simulation to step forward.
+    void startThreads(); ///< @brief Starts the step and report threads asked for by the .sim file or the command line.
+    void ageTile(unsigned int tile, StepBuffers &buffers);  ///< @brief Ages the Animals of one tile and lets them die.
+    void wanderTile(unsigned int tile, TileBuffers &outbox); ///< @brief Decides where the Animals of one tile wander.
+    void departTile(TileBuffers &outbox);                    ///< @brief Removes the Animals wandering out of the Cells of one tile.
+    void arriveTile(TileBuffers &inbox);                     ///< @brief Adds the Animals wandering into the Cells of one tile.
+    void breedTile(unsigned int tile, TileBuffers &outbox);  ///< @brief Lets the Animals of one tile breed.
+    void bearTile(unsigned int tile, TileBuffers &outbox);   ///< @brief Creates the newborns of one tile.
+    void feedTile(unsigned int tile, StepBuffers &buffers);  ///< @brief Lets the Animals of one tile feed.
+    void refreshCell(Cell *loci, StepBuffers &buffers);     ///< @brief Computes the stale fitness values of the inhabitants of a Cell.
+    void feedCell(Cell *loci, StepBuffers &buffers); ///< @brief Lets the Animals of one Cell feed.
+    void bury();          ///< @brief Destroys the Animals recorded as dead by all threads.
+    unsigned int censusOf(unsigned short genus, Cell *loci) { return genus * geography.terrains() + loci->terrain(); } ///< @brief Returns the position in @c census of a species id in a Cell.
+    void recount();       ///< @brief Counts all Animals into @c census.
+    void tally();         ///< @brief Adds the census changes of all threads and tiles to @c census.
     bool createOutputDir(); ///< @brief Creates the output directory if necessary.
     bool openReport_dat();  ///< @brief Opens the .dat report file stream.
     bool writeReport_dat(); ///< @brief Writes to the .dat report file stream.
     void closeReport_dat(); ///< @brief Closes the .dat report file stream.
+    bool writeCheckpoint(); ///< @brief Writes a checkpoint.
+    void readCheckpoint(const std::string &checkpoint, long long &datLength); ///< @brief Restores the Simulation from a checkpoint.
     bool writeReport_dyr(); ///< @brief Writes a .dyr report.
     bool writeReport_for(); ///< @brief Writes a feed report.
     bool writeReport_pop(bool unified=true); ///< @brief Writes a population report.
@@ -65,15 +168,24 @@ namespace BioSim {
     Simulation(); ///< @brief Creates a Simulation object.
     ~Simulation(); ///< @brief Destroys a Simulation object.
     int run();    ///< @brief Runs the Simulation.
+    unsigned int advance(); ///< @brief Steps the Simulation one year, without reports.
+    void threadCount(int n) { thread_override = n; } ///< @brief Sets the number of threads, overriding the .sim file.
+    void resume(const std::string &checkpoint) { _resume = checkpoint; } ///< @brief Makes init() continue from a checkpoint.
     void init(const std::string &parameters);                             ///< @brief Initializes the Simulation.
+    void suspend();                                                       ///< @brief Stops all threads but the caller's, so that the process may fork.
+    void redirect(const std::string &stem);                               ///< @brief Restarts the threads and sends all reports to a new filename base.
+    void adjustSpecies(const std::string &name, const std::string &param, double value); ///< @brief Changes a Species parameter before run().
+    void adjustTerrain(char name, const std::string &param, double value);               ///< @brief Changes a terrain type parameter before run().
     void initGeo(const std::string &archs,const std::string &geo_param);  ///< @brief Initializes the geography Map object.
     void initGeoSpec(const std::string &spec, const std::string &geo_param); ///< @brief Initializes the geography Map object with a spec.
     Species *initSpecies(const std::string &species_par);                 ///< @brief Reads Species.par-file.
     bool readPopulation(const std::string &population);                   ///< @brief Reads population file.
-    Animal *vivify(Species *archetype,unsigned int x, unsigned int y);                                      ///< @brief vivifies an Animal
-    Animal *vivify(const std::string &name,unsigned int x, unsigned int y);                                 ///< @brief vivifies an Animal
-    Animal *insertAnimal(Species *archetype, int age, double weight, unsigned int x, unsigned int y);       ///< @brief inserts a fully qualified Animal
-    Animal *insertAnimal(const std::string &name, int age, double weight, unsigned int x, unsigned int y);  ///< @brief inserts a fully qualified Animal
+    bool readPopulations(const std::list<std::string> &populations);      ///< @brief Reads population files concurrently.
+    size_t insertPopulation(const std::vector<std::string> &names, const PopulationBlock *blocks, size_t count, const PopulationRecord *records); ///< @brief Inserts Animals in bulk.
+    Animal vivify(Species *archetype,unsigned int x, unsigned int y);                                      ///< @brief vivifies an Animal
+    Animal vivify(const std::string &name,unsigned int x, unsigned int y);                                 ///< @brief vivifies an Animal
+    Animal insertAnimal(Species *archetype, int age, double weight, unsigned int x, unsigned int y);       ///< @brief inserts a fully qualified Animal
+    Animal insertAnimal(const std::string &name, int age, double weight, unsigned int x, unsigned int y);  ///< @brief inserts a fully qualified Animal
     Species *genus(const std::string &typeName);      ///< @brief Returns a pointer to the species named typeName
     std::ostream& reportPopulation(std::ostream &os); ///< @brief Fundamental command for the .dat files.
   };
@@ -0,0 +1,131 @@
+/** @file Fitness.h
+ *  @brief This file contains the fitness function, for single Animals and for batches.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#ifndef FITNESS_H
+#define FITNESS_H
+
+#include "prefix.h"
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+/// Arguments of expq() are clamped to [EXPQ_MIN, EXPQ_MAX], which keeps the result finite and normal.
+#define EXPQ_MAX 708.0
+#define EXPQ_MIN -708.0 ///< @brief See EXPQ_MAX.
+#define EXPQ_LOG2E 1.4426950408889634074         ///< @brief log<sub>2</sub>(e).
+#define EXPQ_LN2_HI 6.93147180369123816490e-01   ///< @brief High part of ln(2); t * EXPQ_LN2_HI is exact for |t| <= 1024.
+#define EXPQ_LN2_LO 1.90821492927058770002e-10   ///< @brief Low part of ln(2).
+
+/// @brief Ages below this are looked up in FitnessCurve::q_alder.
+#define FITNESS_AGES 256
+
+namespace BioSim {
+
+  /** @brief The parameters of the fitness function of a Species.
+   *
+   *  Each of the three factors of the fitness function is 1 / (1 + exp(k (x - x<sub>½</sub>))), where k is +Φ or -Φ.
+   *
+   *  The age factor of ages below FITNESS_AGES is tabulated exactly by tabulate(). Optionally, the product of the two weight
+   *  factors is tabulated on an even grid from v_min and interpolated linearly; the table is then made fine enough that the
+   *  interpolation error stays within a given tolerance. Weights beyond the table are computed exactly.
+   *  @ingroup BioSim
+   */
+  struct FitnessCurve {
+    double v_min;        ///< @brief Animals lighter than this have fitness 0.
+    double a_halv;       ///< @brief Age midpoint.
+    double k_alder;      ///< @brief Age coefficient, Φ<sub>alder</sub>.
+    double v_halv_under; ///< @brief Underweight midpoint.
+    double k_under;      ///< @brief Underweight coefficient, -Φ<sub>under</sub>.
+    double v_halv_over;  ///< @brief Overweight midpoint.
+    double k_over;       ///< @brief Overweight coefficient, Φ<sub>over</sub>.
+    std::vector<double> q_alder; ///< @brief Age factor by age; empty until tabulate().
+    std::vector<double> q_vekt;  ///< @brief Weight factors at v_min + i / v_scale; empty unless tabulated.
+    double v_scale;      ///< @brief Weight table points per unit of weight.
+    double v_max;        ///< @brief Weights from this on are not in the weight table.
+    void tabulate();                                ///< @brief Builds the age table and drops the weight table.
+    double tabulate(double tolerance);              ///< @brief Builds both tables; returns the largest interpolation error found.
+    double deviation();                             ///< @brief Returns the largest error of the tables against func_q().
+    double ageTerm(double age) const;               ///< @brief Computes the age factor.
+    double weightTerm(double weight) const;         ///< @brief Computes the product of the weight factors.
+  };
+
+  /** @brief Computes e<sup>x</sup> with a fixed sequence of additions and multiplications.
+   *
+   *  The batch kernels evaluate the very same sequence lane by lane, so an Animal gets the same fitness whether it is computed
+   *  alone or in a batch. The relative error is a few units in the last place.
+   *  @ingroup BioSim
+   */
+  inline double expq(double x) {
+    if (x > EXPQ_MAX) x = EXPQ_MAX;
+    if (x < EXPQ_MIN) x = EXPQ_MIN;
+    double t = std::floor(x * EXPQ_LOG2E + 0.5);
+    double r = x - t * EXPQ_LN2_HI;
+    r = r - t * EXPQ_LN2_LO;
+    // Taylor series of exp(r) to degree 13, |r| <= ln(2)/2.
+    double p = 1.0 / 6227020800.0;
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+    int64_t bits = ((int64_t)t + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+  }
+
+  /// @param age An age. @return The age factor of the fitness function. Tabulated values are exact.
+  inline double FitnessCurve::ageTerm(double age) const {
+    if (age >= 0 && age < q_alder.size()) return q_alder[(size_t)age];
+    return 1.0 / (1.0 + expq(k_alder * (age - a_halv)));
+  }
+
+  /// @param weight A weight of at least v_min. @return The product of the weight factors of the fitness function, exact or interpolated.
+  inline double FitnessCurve::weightTerm(double weight) const {
+    if (!q_vekt.empty() && weight < v_max) {
+      double x = (weight - v_min) * v_scale;
+      size_t i = (size_t)x;
+      if (i + 1 >= q_vekt.size()) i = q_vekt.size() - 2; // Rounding just below v_max.
+      return q_vekt[i] + (x - i) * (q_vekt[i + 1] - q_vekt[i]);
+    }
+    double q_under = 1.0 / (1.0 + expq(k_under * (weight - v_halv_under)));
+    double q_over  = 1.0 / (1.0 + expq(k_over * (weight - v_halv_over)));
+    return q_under * q_over;
+  }
+
+  /** @brief Computes the fitness of one Animal.
+   *  @param curve  The fitness parameters of the Animal's Species.
+   *  @param weight The weight of the Animal.
+   *  @param age    The age of the Animal.
+   *  @return The fitness of the Animal.
+   *  @ingroup BioSim
+   */
+  inline double fitness(const FitnessCurve &curve, double weight, double age) {
+    if (weight < curve.v_min) return 0.0;
+    if (!curve.q_vekt.empty()) return curve.ageTerm(age) * curve.weightTerm(weight);
+    double q_alder = curve.ageTerm(age);
+    double q_under = 1.0 / (1.0 + expq(curve.k_under * (weight - curve.v_halv_under)));
+    double q_over  = 1.0 / (1.0 + expq(curve.k_over * (weight - curve.v_halv_over)));
+    return q_alder * q_under * q_over;
+  }
+
+  void fitness(const FitnessCurve &curve, const double *weight, const double *age, double *phi, size_t n); ///< @brief Computes the fitness of n Animals of one Species. @ingroup BioSim
+  const char *fitnessKernel(); ///< @brief Returns the name of the instruction set used by the batch fitness function. @ingroup BioSim
+}
+
+#endif //FITNESS_H
@@ -7,8 +7,11 @@
  */
 #include "prefix.h"
 #include "read_parameters.h"
+#include "AnimalStore.h"
+#include "Span.h"
+#include "random.h"
 #include <vector>
-#include <set>
+#include <iterator>
 
 #ifdef BIOSIM_PNG
 #include <png.h>
@@ -18,10 +21,11 @@
 namespace BioSim {
 
   class Animal;
+  class AnimalRange;
   class Species;
 
-  unsigned int coordPack (unsigned int x, unsigned int y); ///< @brief Packs coordinates for map lookup. @ingroup BioSim
-  void coordUnpack (unsigned int coord, unsigned int &x, unsigned int &y); ///< @brief Unpacks lookup values into an euclidian context. @ingroup BioSim
+  unsigned long long coordPack (unsigned int x, unsigned int y); ///< @brief Packs coordinates for map lookup. @ingroup BioSim
+  void coordUnpack (unsigned long long coord, unsigned int &x, unsigned int &y); ///< @brief Unpacks lookup values into an euclidian context. @ingroup BioSim
   /** @brief Encapsulates archetypal qualities of geography cells.
    *  @ingroup BioSim
    */
@@ -30,6 +34,7 @@ namespace BioSim {
 	  double _alpha;    ///< @brief Terrain type regrowth coefficient.
 	  double _maxfeed;  ///< @brief Terrain type maximum feed.
 	  bool _live;       ///< @brief Terrain type simulation participation status.
+    unsigned int _terrain; ///< @brief Terrain type number, from 0 to Map::terrains().
 #ifdef BIOSIM_PNG
     png_color _color;   ///< @brief Terrain type Cell color (for drawing) as an 8-bit RGB triplet.
 #endif
@@ -40,7 +45,11 @@ namespace BioSim {
 	  char name();                  ///< @brief Returns the cell type name.
 	  double alpha();               ///< @brief Returns the cell type regrowth coefficient.
 	  double maxfeed();             ///< @brief Returns the cell type maximum feed value.
+    void alpha(double newval) { _alpha = newval; }     ///< @brief Sets the cell type regrowth coefficient.
+    void maxfeed(double newval) { _maxfeed = newval; } ///< @brief Sets the cell type maximum feed value.
 	  bool live();                  ///< @brief Returns true if the cell type participates in the Simulation.
+    unsigned int terrain() { return _terrain; } ///< @brief Returns the terrain type number.
+    void terrain(unsigned int newval) { _terrain = newval; } ///< @brief Sets the terrain type number.
 #ifdef BIOSIM_PNG
     png_color color();             ///< @brief Returns a pointer to the cell type color. (A C-style array of three chars.)
     void color(png_byte redPart,png_byte greenPart,png_byte bluePart); ///< @brief Sets the cell type color.
@@ -57,40 +66,136 @@ namespace BioSim {
     Cell(ArchCell *type);     ///< @brief Creates a Cell.
     bool operator< (Cell &b); ///< @brief Compares two Cell objects irt. pointer value.
     char cellName();          ///< @brief Returns the cell type name.
+    unsigned int terrain();   ///< @brief Returns the terrain type number.
     bool addAnimal();         ///< @brief Returns true if an Animal can enter this cell.
-    bool addAnimal(Animal *beast);    ///< @brief Adds an Animal to the Cell, if possible.
-    void removeAnimal(Animal *beast); ///< @brief Removes an Animal from the Cell.
-    std::vector<Animal*> animals();   ///< @brief Returns all inhabitant Animal pointers.
-    std::vector<Animal *> cellMates(Species* genus,bool breedersOnly=false); ///< @brief Returns all inhabitant Animal pointers of Species genus.
-    std::vector<Animal *> cellMates(Animal * beast,bool breedersOnly=false); ///< @brief Returns all inhabitant Animal pointers of same type as beast.
-    std::vector<Animal *> breed(std::vector<Species*> genera); ///< @brief Causes all animals in the cell to attempt breeding.
-    void wander();                ///< @brief Causes all animals in the cell to attempt wandering.
+    bool addAnimal(Animal beast);     ///< @brief Adds an Animal to the Cell, if possible.
+    void removeAnimal(Animal beast);  ///< @brief Removes an Animal from the Cell.
+    void matureAll();                 ///< @brief Counts every inhabitant among the breeders.
+    void evict();                     ///< @brief Forgets all inhabitants, without touching the AnimalStore.
+    void settle(AnimalHandle beast);  ///< @brief Puts an Animal back at the place recorded in the AnimalStore.
+    void stock(double ammount) { feed = ammount; _dirty = true; } ///< @brief Sets the ammount of feed in the Cell.
+    unsigned int cull(unsigned short genus, const unsigned char *doomed, std::vector<AnimalHandle> &dead); ///< @brief Removes the marked Animals of a species id at once.
+    unsigned int headcount() {return _headcount;} ///< @brief Returns the number of inhabitant Animals.
+    unsigned int headcount(unsigned short genus, bool breedersOnly=false); ///< @brief Returns the number of inhabitant Animals of a species id.
+    Animal habitant(unsigned short genus, unsigned int i); ///< @brief Returns inhabitant number i of a species id.
+    unsigned short genera() {return habitants.size();} ///< @brief Returns one more than the highest species id that has been in the Cell.
+    std::vector<Animal> animals();    ///< @brief Returns all inhabitant Animals.
+    std::vector<Animal> cellMates(Species* genus,bool breedersOnly=false); ///< @brief Returns all inhabitant Animals of Species genus.
+    std::vector<Animal> cellMates(Animal beast,bool breedersOnly=false);   ///< @brief Returns all inhabitant Animals of same type as beast.
+    AnimalRange inhabitants(unsigned short genus,bool breedersOnly=false); ///< @brief Returns a view of the inhabitant Animals of a species id.
+    void breed(const std::vector<Species*> &genera, toolbox::RandomStream &rng, std::vector<unsigned short> &litter); ///< @brief Causes all animals in the cell to attempt breeding, without creating the newborns.
     double graze(double ammount); ///< @brief Animal grazing function.
     void regrow();                ///< @brief Causes cell food to be regrown.
     double graze();               ///< @brief Returns the ammount of feed in the Cell.
     std::vector<Cell*> neighbours();            ///< @brief Returns pointer to neighbours.
-    void neighbours(std::vector<Cell*> newval); ///< @brief Sets pointers to neighbours.
+    void neighbours(const std::vector<Cell*> &newval); ///< @brief Sets pointers to neighbours.
+    Span<Cell* const> neighbourhood() { return Span<Cell* const>(_neighbours, 4); } ///< @brief Returns a view of the pointers to neighbours.
+    Cell *neighbour(unsigned int i) { return _neighbours[i]; } ///< @brief Returns neighbour i (west, north, east, south), or @c NULL.
     int x_pos() {return _x_loc;}                ///< @brief Returns the Cell's recorded x coordinate.
     void x_pos(int newval) {_x_loc = newval;}   ///< @brief Sets the Cell's x coordinate.
     int y_pos() {return _y_loc;}                ///< @brief Returns the Cell's recorded y coordinate.
     void y_pos(int newval) {_y_loc = newval;}   ///< @brief Sets the Cell's y coordinate.
+    unsigned int index() {return _index;}       ///< @brief Returns the Cell's index in the Map.
+    void index(unsigned int newval) {_index = newval;} ///< @brief Sets the Cell's index in the Map.
+    void population(AnimalStore *store) {_store = store;} ///< @brief Sets the AnimalStore holding the inhabitant Animals.
+    toolbox::RandomStream &random() {return _random;}     ///< @brief Returns the Cell's random stream, used for predation. Set before feeding.
 #ifdef BIOSIM_PNG
     png_color color() { return archetype->color(); } ///< @brief Returns the Cell type color.
     png_color animalDensity(); ///< @brief Returns a color representing the density of animals in the cell.
     png_color foodDensity();   ///< @brief Returns a color representing the density of foodstuffs in the cell.
+    int foodLevel();           ///< @brief Returns the index of foodDensity() in the color table, or -1 if there is no feed to show.
+    bool dirty() { return _dirty; } ///< @brief Returns true if the Cell may look different since it was last drawn.
+    void drawn() { _dirty = false; } ///< @brief Records that the Cell has been drawn.
 #endif
   private:
-    std::vector<Cell*> _neighbours;   ///< @brief Pointers to neighbouring Cell instances.
+    /** @brief The inhabitants of a Cell that belong to one Species.
+     *
+     *  Animals of age 1 or more (breeders) are kept first, followed by the @c juveniles Animals of age 0.
+     *  The position of each Animal is recorded in AnimalStore::place(), so that any Animal can be removed in constant time
+     *  by moving the last breeder and the last juvenile into the hole.
+     */
+    struct Bucket {
+      std::vector<AnimalHandle> beasts; ///< @brief Handles of the Animals, breeders first.
+      unsigned int juveniles;           ///< @brief Number of Animals of age 0 at the end of @c beasts.
+      Bucket() : juveniles(0) {}        ///< @brief Creates an empty Bucket.
+    };
+    void shift(Bucket &bucket, unsigned int from, unsigned int to); ///< @brief Moves a handle within a Bucket.
+    Cell *_neighbours[4];             ///< @brief Pointers to neighbouring Cell instances.
     ArchCell *archetype;              ///< @brief Pointer to terrain ArchCell
     double feed;                      ///< @brief Ammount of remaining feed in Cell
-    std::set<Animal *> habitants;     ///< @brief Pointers to inhabitant Animal instances. A set is used to ensure that no pointer exists twice.
+    std::vector<Bucket> habitants;    ///< @brief The inhabitant Animals, one Bucket per species id.
+    unsigned int _headcount;          ///< @brief The number of inhabitant Animals.
+    bool _dirty;                      ///< @brief Set when the headcount or the feed changes; cleared when the Cell is drawn.
+    AnimalStore *_store;              ///< @brief The AnimalStore holding the inhabitant Animals.
     int _x_loc;                       ///< @brief The Cell's x coordinate.
     int _y_loc;                       ///< @brief The Cell's y coordinate.
+    unsigned int _index;              ///< @brief The Cell's index in the Map, as recorded by AnimalStore.
+    toolbox::RandomStream _random;    ///< @brief Random stream for events confined to the Cell.
+  };
+
+  /** @brief A view of Cells of a Map, either all of them in index order or those given by a Span of indices.
+   *
+   *  Iterating a CellRange yields Cell pointers and never allocates.
+   *  @ingroup BioSim
+   */
+  class CellRange {
+    Cell *base;                    ///< @brief The first Cell of the Map.
+    const unsigned int *indices;   ///< @brief The indices of the Cells in the range, or @c NULL for all Cells.
+    size_t count;                  ///< @brief The number of Cells in the range.
+  public:
+    /// @brief Forward iterator over a CellRange.
+    class iterator {
+      Cell *base;                  ///< @brief The first Cell of the Map.
+      const unsigned int *indices; ///< @brief The indices of the Cells in the range, or @c NULL for all Cells.
+      size_t pos;                  ///< @brief The current position in the range.
+    public:
+      typedef std::forward_iterator_tag iterator_category; ///< @brief Iterator traits.
+      typedef Cell* value_type;        ///< @brief Iterator traits.
+      typedef std::ptrdiff_t difference_type; ///< @brief Iterator traits.
+      typedef Cell** pointer;          ///< @brief Iterator traits.
+      typedef Cell* reference;         ///< @brief Iterator traits; elements are returned by value.
+      iterator() : base(NULL), indices(NULL), pos(0) {} ///< @brief Creates a singular iterator.
+      iterator(Cell *base, const unsigned int *indices, size_t pos) : base(base), indices(indices), pos(pos) {} ///< @brief Creates an iterator.
+      Cell *operator* () const { return indices ? base + indices[pos] : base + pos; } ///< @brief Returns the current Cell.
+      iterator &operator++ () { ++pos; return *this; }                    ///< @brief Advances the iterator.
+      iterator operator++ (int) { iterator old = *this; ++pos; return old; } ///< @brief Advances the iterator.
+      bool operator== (const iterator &b) const { return pos == b.pos; }   ///< @brief Compares iterators of the same range.
+      bool operator!= (const iterator &b) const { return pos != b.pos; }   ///< @brief Compares iterators of the same range.
+    };
+    CellRange(Cell *base, size_t count) : base(base), indices(NULL), count(count) {} ///< @brief Creates a range of the first count Cells.
+    CellRange(Cell *base, Span<const unsigned int> indices) : base(base), indices(indices.begin()), count(indices.size()) {} ///< @brief Creates a range of the indexed Cells.
+    iterator begin() const { return iterator(base, indices, 0); }      ///< @brief Returns an iterator to the first Cell.
+    iterator end() const { return iterator(base, indices, count); }    ///< @brief Returns an iterator past the last Cell.
+    size_t size() const { return count; }                              ///< @brief Returns the number of Cells.
+    bool empty() const { return !count; }                              ///< @brief Returns true if there are no Cells.
+    Cell *operator[] (size_t i) const { return indices ? base + indices[i] : base + i; } ///< @brief Returns Cell number i.
   };
 
   /** @brief Encapsulates Map data functionality.
    *  @ingroup BioSim
    */
+  /// @brief Default side length, in Cells, of the tiles of a Map.
+#ifndef MAP_TILE
+#define MAP_TILE 16
+#endif
+
+#ifdef BIOSIM_PNG
+  /// @brief Rows of the map image compressed as one strip when a PNG report is encoded on several threads.
+#ifndef PNG_STRIP
+#define PNG_STRIP 128
+#endif
+
+  /** @brief How hard PNG reports are compressed; set by the @c PNGProfil keyword.
+   *  @ingroup BioSim
+   */
+  enum PngProfile {
+    PNG_FAST,     ///< @brief @c rask: zlib level 1.
+    PNG_BALANCED, ///< @brief @c balansert: zlib level 6.
+    PNG_ARCHIVAL  ///< @brief @c arkiv: zlib level 9, Z_BEST_COMPRESSION. The default.
+  };
+  PngProfile pngProfile(const std::string &name); ///< @brief Returns the profile with a given keyword name. @ingroup BioSim
+#endif
+
   class Map {
 	public:
 	  Map();                                            ///< @brief Creates a new Map.
@@ -99,32 +204,54 @@ namespace BioSim {
     void initSpec(const std::string &cellSpec);       ///< @brief Initializes ArchCell data from cellSpec
 	  void init(const std::string &geography);          ///< @brief Initializes the map with geography.
 	  Cell * at(unsigned int x, unsigned int y);        ///< @brief Returns a pointer to the Cell at x, y.
-	  Cell * at(unsigned int coord);                    ///< @brief Returns a pointer to the Cell at coord.
+	  Cell * at(unsigned long long coord);              ///< @brief Returns a pointer to the Cell at coord.
+    Cell * cell(unsigned int index) { return &cells[index]; } ///< @brief Returns a pointer to the Cell with the given index.
+    unsigned int index(unsigned int x, unsigned int y) { return y * _cols + x; } ///< @brief Returns the index of the Cell at x, y.
+    unsigned int rows() { return _rows; }             ///< @brief Returns the number of rows in the Map.
+    unsigned int cols() { return _cols; }             ///< @brief Returns the number of columns in the Map.
+    unsigned int size() { return cells.size(); }      ///< @brief Returns the number of Cells in the Map; all Cell indices are below this value.
+    void population(AnimalStore *store);              ///< @brief Sets the AnimalStore for every Cell.
     std::vector<Cell*> mapMap(bool allcells = false); ///< @brief Returns packed coordinates to every Map Cell.
-    std::vector<Animal *> cellMates(Species *genus, unsigned int x, unsigned int y);  ///< @brief Wraps BioSim::Cell::cellMates.
-    std::vector<Animal *> cellMates(Animal *beast, unsigned int x, unsigned int y);   ///< @brief Wraps BioSim::Cell::cellMates.
+    CellRange mapView(bool allcells = false);         ///< @brief Returns a view of the live Cells, or of every Map Cell.
+    void partition(unsigned int side);                ///< @brief Divides the live Cells into square tiles.
+    void resettle(AnimalStore *store);                ///< @brief Rebuilds the inhabitants of every Cell from an AnimalStore.
+    unsigned int tiles() { return _tileStart.size() - 1; } ///< @brief Returns the number of tiles.
+    CellRange tile(unsigned int i) { return CellRange(cells.data(), Span<const unsigned int>(&_tileCells[_tileStart[i]], &_tileCells[0] + _tileStart[i + 1])); } ///< @brief Returns the live Cells of tile i, row by row.
+    unsigned int tileOf(unsigned int index) { return _tileOf[index]; } ///< @brief Returns the tile of the Cell with the given index.
+    unsigned int terrains() { return _terrains.size(); }           ///< @brief Returns the number of terrain types.
+    ArchCell *terrain(unsigned int i) { return _terrains[i]; }     ///< @brief Returns terrain type number i.
+    ArchCell *archetype(char name);                   ///< @brief Returns the terrain type with a given name, or @c NULL.
+    std::vector<Animal> cellMates(Species *genus, unsigned int x, unsigned int y);  ///< @brief Wraps BioSim::Cell::cellMates.
+    std::vector<Animal> cellMates(Animal beast, unsigned int x, unsigned int y);    ///< @brief Wraps BioSim::Cell::cellMates.
 #ifdef BIOSIM_PNG
     png_bytepp mapImage();                              ///< @brief Returns a pointer to the map image.
     bool writeReport_png(const std::string &fname);     ///< @brief Writes a PNG report to @c fname
+    std::vector<png_byte> snapshotImage();              ///< @brief Updates the map image and copies its changing rows.
+    bool writeImage(const std::string &fname, const std::vector<png_byte> &snapshot, PngProfile profile = PNG_ARCHIVAL, unsigned int threads = 1) const; ///< @brief Writes a PNG report from a snapshot.
 #endif
 	private:
     std::vector<Cell*> candidatesAt(unsigned int x, unsigned int y); ///< @brief Utility function.
-    std::vector<Cell*> candidatesAt(unsigned int coord);             ///< @brief Utility function.
+    std::vector<Cell*> candidatesAt(unsigned long long coord);       ///< @brief Utility function.
 	  toolbox::ReadParameters param_reader_;                           ///< @brief Parameter file reader.
 	  double _alpha;   ///< @brief Parameter reader target value.
 	  int _fmax_jngl; ///< @brief Parameter reader target value.
 	  int _fmax_sav;  ///< @brief Parameter reader target value.
-    std::map<unsigned int,Cell> cells;   ///< @brief Map data map.
+    std::vector<Cell> cells;             ///< @brief Map data, row by row. A Cell's position in this vector is its index.
 	  std::map<char,ArchCell> archetypes;  ///< @brief ArchCell data map.
+    std::vector<ArchCell*> _terrains;    ///< @brief The ArchCells by terrain type number, in order of name.
     unsigned int _rows; ///< @brief Control and generation value, number of rows in map.
     unsigned int _cols; ///< @brief Control and generation value, number of columns in map.
-    std::vector<Cell*> _adrMap;     ///< @brief Packed coordinate values of all live Cells in simulation.
-    std::vector<Cell*> _fullAdrMap; ///< @brief Packed coordinate values of all Cells in simulation.
+    std::vector<unsigned int> _adrMap; ///< @brief Indices of all live Cells in simulation. The indices of all Cells are simply [0, size()).
+    std::vector<unsigned int> _tileCells; ///< @brief Indices of the live Cells, tile by tile.
+    std::vector<unsigned int> _tileStart; ///< @brief Position in _tileCells of the first Cell of each tile, and one past the last tile.
+    std::vector<unsigned int> _tileOf;    ///< @brief Tile of each Cell, by index.
 #ifdef BIOSIM_PNG
     png_bytepp mapImageBuffer;      ///< @brief A buffer containing map data.
     void initMapImageBuffer();    ///< @brief Initializes the map data.
     void updateMapImageBuffer();  ///< @brief Updates the map data.
     void destroyMapImageBuffer(); ///< @brief Destroys and frees the map data.
+    std::vector<png_color> _animalShades; ///< @brief animalDensity() of a live Cell, by headcount up to the darkest shade.
+    std::vector<png_color> _foodShades;   ///< @brief foodDensity() of a Cell, by Cell::foodLevel().
 #endif
   };
 }
@@ -0,0 +1,138 @@
+/** @file Population.h
+ *  @brief This file contains the population file formats: the text .pop format and the binary .bpop format.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#ifndef POPULATION_H
+#define POPULATION_H
+
+#include "prefix.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/// @brief Identifies a .bpop file.
+#define POPULATION_MAGIC "BioSimBP"
+/// @brief The .bpop format version; files of other versions are refused.
+#define POPULATION_VERSION 1
+/// @brief Size of a species name in a .bpop file, including the terminating zero.
+#define POPULATION_NAME 32
+/// @brief Bytes of a text .pop file parsed by one task; larger files are split into chunks and parsed in parallel.
+#ifndef POPULATION_CHUNK
+#define POPULATION_CHUNK (1 << 20)
+#endif
+
+namespace BioSim {
+
+  /** @brief The header at the start of a .bpop file.
+   *
+   *  A .bpop file consists of, in order: this header; the name of the geography, padded with zeros to a multiple of 8 bytes;
+   *  @c genera PopulationSpecies; @c blocks PopulationBlock; and @c animals PopulationRecord. All numbers are in the byte order
+   *  of the machine that wrote the file.
+   *  @ingroup BioSim
+   */
+  struct PopulationHeader {
+    char magic[8];      ///< @brief POPULATION_MAGIC, without a terminating zero.
+    uint32_t version;   ///< @brief POPULATION_VERSION.
+    uint32_t genera;    ///< @brief Number of species in the species table.
+    uint32_t blocks;    ///< @brief Number of Cell blocks.
+    uint32_t geography; ///< @brief Length of the name of the geography.
+    uint64_t animals;   ///< @brief Number of Animal records.
+  };
+
+  /// @brief An entry of the species table of a .bpop file. @ingroup BioSim
+  struct PopulationSpecies {
+    char name[POPULATION_NAME]; ///< @brief The name of the Species, zero-terminated.
+  };
+
+  /// @brief The Animals of one species in one Cell; the counterpart of a "name x y count" line of a .pop file. @ingroup BioSim
+  struct PopulationBlock {
+    uint32_t x;         ///< @brief X coordinate of the Cell.
+    uint32_t y;         ///< @brief Y coordinate of the Cell.
+    uint32_t genus;     ///< @brief Position of the Species in the species table.
+    uint32_t count;     ///< @brief Number of Animals.
+    uint64_t first;     ///< @brief Position of the record of the first Animal.
+  };
+
+  /// @brief The age and weight of one Animal. @ingroup BioSim
+  struct PopulationRecord {
+    double vekt;        ///< @brief Weight.
+    int32_t alder;      ///< @brief Age.
+    uint32_t reserved;  ///< @brief Zero; pads the record to 16 bytes.
+  };
+
+  /** @brief A .bpop file, mapped read-only into memory.
+   *
+   *  The tables are used in place; nothing is copied or parsed. The file is checked for consistency when it is mapped.
+   *  @ingroup BioSim
+   */
+  class PopulationMap {
+    char *_base;   ///< @brief Start of the mapping.
+    size_t _size;  ///< @brief Size of the mapping in bytes.
+    const PopulationHeader *_header;   ///< @brief The header.
+    const PopulationSpecies *_genera;  ///< @brief The species table.
+    const PopulationBlock *_blocks;    ///< @brief The Cell blocks.
+    const PopulationRecord *_records;  ///< @brief The Animal records.
+    PopulationMap(const PopulationMap&);            ///< @brief Mappings can not be copied.
+    PopulationMap& operator=(const PopulationMap&); ///< @brief Mappings can not be copied.
+  public:
+    explicit PopulationMap(const std::string &path); ///< @brief Maps a .bpop file.
+    ~PopulationMap();                                ///< @brief Unmaps the file.
+    static bool recognize(const std::string &path);  ///< @brief Returns true if a file starts like a .bpop file.
+    std::string geography() const;                   ///< @brief Returns the name of the geography.
+    unsigned int genera() const { return _header->genera; }       ///< @brief Returns the number of species.
+    std::string genus(unsigned int i) const { return _genera[i].name; } ///< @brief Returns the name of species i.
+    size_t blockCount() const { return _header->blocks; }         ///< @brief Returns the number of Cell blocks.
+    const PopulationBlock *blocks() const { return _blocks; }     ///< @brief Returns the Cell blocks.
+    size_t animals() const { return _header->animals; }           ///< @brief Returns the number of Animal records.
+    const PopulationRecord *records() const { return _records; }  ///< @brief Returns the Animal records.
+  };
+
+  struct Population;
+
+  /** @brief A text .pop file, read into memory in one piece.
+   *
+   *  The file is parsed in place, without streams: numbers are read with strtol() and strtod(), and comments are skipped
+   *  wherever a token may start. The part after the Geografi line may be split into chunks at Cell block boundaries; the
+   *  chunks can then be parsed independently, each into a Population of its own, and read in order they give the same
+   *  Animals as parsing the whole file.
+   *  @ingroup BioSim
+   */
+  class PopulationText {
+    std::string _path;           ///< @brief The pathname of the file.
+    std::vector<char> _text;     ///< @brief The contents of the file, followed by a zero.
+    std::vector<size_t> _chunks; ///< @brief Chunk boundaries; chunk i runs from _chunks[i] to _chunks[i+1].
+    std::string _geography;      ///< @brief The name of the geography.
+    void fail(const char *at, const char *expected) const; ///< @brief Throws a parse error naming the line.
+  public:
+    explicit PopulationText(const std::string &path); ///< @brief Reads a .pop file and its Geografi line.
+    const std::string &geography() const { return _geography; } ///< @brief Returns the name of the geography.
+    size_t size() const { return _text.size() - 1; }  ///< @brief Returns the size of the file in bytes.
+    void split(size_t parts);                         ///< @brief Splits the Cell blocks into at most @c parts chunks.
+    size_t chunks() const { return _chunks.size() - 1; } ///< @brief Returns the number of chunks.
+    void parse(size_t chunk, Population &part) const; ///< @brief Appends the Cell blocks of a chunk to a Population.
+  };
+
+  /** @brief A population held in memory, in the layout of a .bpop file.
+   *
+   *  Used to convert between the text and binary formats.
+   *  @ingroup BioSim
+   */
+  struct Population {
+    std::string geography;                  ///< @brief The name of the geography.
+    std::vector<std::string> genera;        ///< @brief The species table.
+    std::vector<PopulationBlock> blocks;    ///< @brief The Cell blocks.
+    std::vector<PopulationRecord> records;  ///< @brief The Animal records.
+    unsigned int genus(const std::string &name);    ///< @brief Returns the position of a species, adding it if necessary.
+    void readText(const std::string &path);         ///< @brief Reads a .pop file.
+    void readBinary(const std::string &path);       ///< @brief Reads a .bpop file.
+    void writeText(const std::string &path) const;  ///< @brief Writes a .pop file.
+    void writeBinary(const std::string &path) const; ///< @brief Writes a .bpop file.
+  };
+}
+
+#endif //POPULATION_H
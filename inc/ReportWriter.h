@@ -0,0 +1,65 @@
+/** @file ReportWriter.h
+ *  @brief This file contains the ReportWriter class, a set of background threads that write reports.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#ifndef REPORTWRITER_H
+#define REPORTWRITER_H
+
+#include "prefix.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/// @brief The number of reports that may wait to be written before the Simulation has to wait for the writers.
+#ifndef REPORT_QUEUE
+#define REPORT_QUEUE 4
+#endif
+
+namespace BioSim {
+
+  /** @brief Writes reports on background threads, so that the Simulation can go on with the next year meanwhile.
+   *
+   *  A report is handed over as a job that owns a snapshot of everything it needs, and formats, compresses and writes it
+   *  without touching the Simulation. The queue is bounded; submit() waits while it is full, so that the snapshots of a
+   *  Simulation outrunning its writers do not pile up. Without threads, jobs are run directly by submit().
+   *  @ingroup BioSim
+   */
+  class ReportWriter {
+  public:
+    typedef std::function<bool ()> Job; ///< @brief Writes one report; returns false on failure.
+    explicit ReportWriter(unsigned int threads = 0, size_t depth = REPORT_QUEUE); ///< @brief Creates a writer with @c threads threads.
+    ~ReportWriter();                          ///< @brief Writes the waiting reports and joins the threads.
+    void resize(unsigned int threads);        ///< @brief Changes the number of threads.
+    void submit(const std::string &name, const Job &job); ///< @brief Queues a report, waiting while the queue is full.
+    void drain();                             ///< @brief Waits until all queued reports have been written.
+  private:
+    /// @brief A queued report.
+    struct Task {
+      std::string name; ///< @brief The name of the report, for warnings.
+      Job job;          ///< @brief The job writing it.
+    };
+    std::vector<std::thread> _workers;  ///< @brief The writer threads.
+    std::deque<Task> _queue;            ///< @brief Reports waiting to be written.
+    size_t _depth;                      ///< @brief The largest number of waiting reports.
+    unsigned int _busy;                 ///< @brief Reports being written.
+    bool _stop;                         ///< @brief Tells the writers to exit once the queue is empty.
+    std::mutex _lock;                   ///< @brief Guards the fields above.
+    std::condition_variable _work;      ///< @brief Signals the writers that a report was queued, or to stop.
+    std::condition_variable _space;     ///< @brief Signals submit() and drain() that a report was taken or written.
+    void work();                        ///< @brief Writer thread main loop.
+    void stop();                        ///< @brief Writes the waiting reports and joins the writers.
+    static void write(const Task &task); ///< @brief Runs a job, warning on failure.
+    ReportWriter(const ReportWriter&);            ///< @brief Writers can not be copied.
+    ReportWriter& operator=(const ReportWriter&); ///< @brief Writers can not be copied.
+  };
+}
+
+#endif //REPORTWRITER_H
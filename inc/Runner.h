@@ -0,0 +1,28 @@
+/** @file Runner.h
+ *  @brief This file contains runForked(), which runs jobs in parallel processes.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include "prefix.h"
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace BioSim {
+
+  /** @brief Runs a job once for each label, in forked processes, up to @c jobs at a time.
+   *
+   *  The console output of each job is held back until it ends, and then printed as a whole under its label.
+   *  @return The sum of the exit codes of the jobs.
+   *  @ingroup BioSim
+   */
+  int runForked(const std::vector<std::string> &labels, unsigned int jobs, const std::function<int (size_t)> &job);
+}
+
+#endif //RUNNER_H
@@ -0,0 +1,40 @@
+/** @file Span.h
+ *  @brief This file contains the Span class template, a non-owning view of contiguous elements.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <cstddef>
+
+namespace BioSim {
+
+  /** @brief A view of a contiguous sequence of elements owned by someone else.
+   *
+   *  A Span is two pointers; creating, copying and iterating one never allocates. A Span is invalidated by anything that
+   *  reallocates or reorders the underlying storage; for views of Cell contents, that is any Animal entering or leaving the Cell.
+   *  @ingroup BioSim
+   */
+  template <typename T>
+  class Span {
+    T *_begin; ///< @brief The first element.
+    T *_end;   ///< @brief One past the last element.
+  public:
+    typedef T* iterator;     ///< @brief Iterator type.
+    typedef T value_type;    ///< @brief Element type.
+    Span() : _begin(NULL), _end(NULL) {}                   ///< @brief Creates an empty Span.
+    Span(T *first, T *last) : _begin(first), _end(last) {} ///< @brief Creates a Span of [first, last).
+    Span(T *first, size_t count) : _begin(first), _end(first + count) {} ///< @brief Creates a Span of count elements.
+    T *begin() const { return _begin; }                    ///< @brief Returns the first element.
+    T *end() const { return _end; }                        ///< @brief Returns one past the last element.
+    size_t size() const { return _end - _begin; }          ///< @brief Returns the number of elements.
+    bool empty() const { return _begin == _end; }          ///< @brief Returns true if there are no elements.
+    T &operator[] (size_t i) const { return _begin[i]; }   ///< @brief Returns element i.
+  };
+}
+
+#endif //SPAN_H
@@ -0,0 +1,54 @@
+/** @file Sweep.h
+ *  @brief This file contains the Sweep class, which runs one Simulation over many parameter sets.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "prefix.h"
+#include <string>
+#include <vector>
+
+namespace BioSim {
+
+  /** @brief A parameter sweep: one .sim file, run once for every point of a sampled parameter space.
+   *
+   *  The Simulation is initialized once; its Map and populations are then shared by all runs, each a forked copy with its own
+   *  parameter values, writing its reports under @c Utdata.NNNN. When all have ended, their .dat reports are gathered into a
+   *  single table, @c Utdata.tab, with one row per run and year.
+   *  @ingroup BioSim
+   */
+  class Sweep {
+  public:
+    /// @brief A swept parameter.
+    struct Axis {
+      std::string target; ///< @brief The name of the Species, or of the terrain type if @c terrain.
+      bool terrain;       ///< @brief Indicates a terrain type parameter.
+      std::string param;  ///< @brief The keyword of the parameter.
+      double low;         ///< @brief The smallest value.
+      double high;        ///< @brief The largest value.
+      unsigned int steps; ///< @brief The number of values on the grid.
+    };
+    Sweep();                                          ///< @brief Creates an empty Sweep.
+    void init(const std::string &description);        ///< @brief Reads a sweep description and samples its points.
+    size_t runs() { return _points.size(); }          ///< @brief Returns the number of runs.
+    int run(unsigned int jobs, int threads);          ///< @brief Runs the Simulation for every point and gathers the results.
+  private:
+    std::string _simulation;                  ///< @brief The pathname of the .sim file.
+    std::string _output;                      ///< @brief The filename base of the runs and of the table.
+    std::string _method;                      ///< @brief The sampling method: @c rutenett, @c tilfeldig or @c latinsk.
+    unsigned int _samples;                    ///< @brief The number of points for @c tilfeldig and @c latinsk.
+    int _seed;                                ///< @brief The random seed for @c tilfeldig and @c latinsk.
+    std::vector<Axis> _axes;                  ///< @brief The swept parameters.
+    std::vector<std::vector<double> > _points; ///< @brief The parameter values of each run, by axis.
+    void sample();                            ///< @brief Fills @c _points by the sampling method.
+    std::string stem(size_t run);             ///< @brief Returns the filename base of a run.
+    bool gather();                            ///< @brief Writes the table from the .dat reports of the runs.
+  };
+}
+
+#endif //SWEEP_H
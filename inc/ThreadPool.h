@@ -0,0 +1,59 @@
+/** @file ThreadPool.h
+ *  @brief This file contains the ThreadPool class, a fixed set of threads that run batches of numbered tasks.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "prefix.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+namespace BioSim {
+
+  /** @brief A persistent set of worker threads for data-parallel phases.
+   *
+   *  run() hands out the tasks 0 to n-1 of a job, one at a time, to the workers and to the calling thread, and returns when
+   *  all are done. The threads are created once and sleep between jobs, so a job costs two wake-ups rather than thread
+   *  creation. Each task is also told which thread runs it, 0 being the calling thread, so that tasks can use per-thread
+   *  scratch space. Which thread runs which task varies from run to run; tasks must not depend on it for their results.
+   *  @ingroup BioSim
+   */
+  class ThreadPool {
+  public:
+    typedef std::function<void (size_t task, unsigned int thread)> Job; ///< @brief A job; called once for each task.
+    explicit ThreadPool(unsigned int threads = 1); ///< @brief Creates a pool of @c threads threads, including the caller.
+    ~ThreadPool();                                 ///< @brief Stops and joins the workers.
+    void resize(unsigned int threads);             ///< @brief Changes the number of threads.
+    unsigned int size() const { return _workers.size() + 1; } ///< @brief Returns the number of threads, including the caller.
+    void run(size_t tasks, const Job &job);        ///< @brief Runs tasks 0 to tasks-1 of job and waits for them.
+  private:
+    std::vector<std::thread> _workers;  ///< @brief The worker threads; the calling thread is thread 0.
+    std::mutex _lock;                   ///< @brief Guards the fields below.
+    std::condition_variable _wake;      ///< @brief Signals a new job or shutdown to the workers.
+    std::condition_variable _done;      ///< @brief Signals the caller that the last worker has finished.
+    const Job *_job;                    ///< @brief The current job.
+    size_t _tasks;                      ///< @brief The number of tasks in the current job.
+    std::atomic<size_t> _next;          ///< @brief The next task to hand out.
+    unsigned int _busy;                 ///< @brief Workers still working on the current job.
+    unsigned long _generation;          ///< @brief Counts jobs, so that workers can tell a new job from a spurious wake-up.
+    bool _stop;                         ///< @brief Tells the workers to exit.
+    std::exception_ptr _error;          ///< @brief The first exception thrown by a task of the current job.
+    void work(unsigned int thread, unsigned long seen); ///< @brief Worker thread main loop.
+    void drain(unsigned int thread);    ///< @brief Runs tasks until none are left.
+    void stop();                        ///< @brief Stops and joins the workers.
+    ThreadPool(const ThreadPool&);            ///< @brief Pools can not be copied.
+    ThreadPool& operator=(const ThreadPool&); ///< @brief Pools can not be copied.
+  };
+}
+
+#endif //THREADPOOL_H
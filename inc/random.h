@@ -3,7 +3,7 @@
 
 /** @file random.h
     Tools for random number generation.
-    
+
     This file contains tool for the generation of random numbers.
 
     This file is part of BioSim.
@@ -14,8 +14,8 @@
 
 */
 
-#include <cstdlib>
-#include <stdexcept>
+#include <stdint.h>
+#include <iosfwd>
 
 /** @defgroup toolbox The Biosim Toolbox.
     This group collects all toolbox classes provided for the BioSim project.
@@ -27,151 +27,203 @@
 
 namespace toolbox {
 
-  /** Random generator for use with BioSim.
-      This class provides a comfortable random generator interface for the
-      BioSim project. If the generator itself should be updated later, the
-      BioSim software need not be changed, since the interface does not
-      change.  The random generator should be used like this:
+  /** Philox4x32-10 block function.
+      Encrypts a 128 bit counter under a 64 bit key, giving 128 random
+      bits. Every distinct (counter, key) pair gives an independent
+      block, so random numbers can be computed directly from their
+      address instead of from the numbers drawn before them.
+      @param ctr Counter; replaced by the random block.
+      @param key Key; not modified.
+      @see Salmon et al, Parallel Random Numbers: As Easy as 1, 2, 3,
+      SC11, 2011.
+      @ingroup toolbox
+  */
+  void philox(uint32_t ctr[4], const uint32_t key[2]);
+
+  /** Sequence of random numbers at one address.
+      A RandomStream draws the blocks with counters (n, entity, year,
+      phase) for n = 0, 1, 2, ... under the key given by the seed. The
+      stream is a plain value: it is cheap to create, may be copied,
+      and two streams never share state, so streams for different
+      entities can be used from different threads.
+
+      Obtain streams from RandomGenerator::stream():
 
       @code
       #include "random.h"
-      using toolbox::randomGen;
+      using toolbox::RandomGenerator;
+      using toolbox::RandomStream;
 
       int main()
       {
-        unsigned int seed = 0;
-        cin >> seed;
-        randomGen(seed);  // seed random generator
+        RandomGenerator rng(55);   // seed random generator
+        rng.year(1);
 
+        RandomStream s = rng.stream(0, 17);  // phase 0, entity 17
         for ( int j = 0 ; j < 5 ; ++j )
-          cout << randomGen().drand() << ' '   // [0,1) double tall
-               << randomGen().nrand(3)         // tall fra {0, 1, 2, 3} 
+          cout << s.drand() << ' '   // [0,1) double tall
+               << s.nrand(3)         // tall fra {0, 1, 2}
                << endl;
 
         return 0;
       }
       @endcode
 
-      @c randomGen() is a function declared in @c random.h.
-
-      @note RandomGenerator employs the Singleton pattern (Meyers
-      Singleton) to ensure that there is exactly one RNG instance per
-      program, and that there is a single, globally accessible access
-      point to this instance. Some additional checks are added to
-      handle seeding gracefully, but safe.  This may reduce in loss of
-      efficiency.
-
-      @see For more on the Singleton pattern, see
-      - Scott Meyers, More Effective C++, ch. 26, Addison-Wesley 1996
-      - Erich Gamma et al, Design Patterns, pp 127ff, Addison-Wesley 1994
-      - Andrei Alexandrescu, Modern C++ Design, ch. 6, Addison-Wesley 2001
+      @ingroup toolbox
+  */
 
-      @todo Check out how much performance we loose through this
-      carefully controlled singleton setup.
+  class RandomStream {
 
-      @note RandomGenerator presently wraps the system RNG. This is a bad
-      idea generally. Replace with something better (eg Mersenne-Twister)
-      before using the RandomGenerator class for serious research.
+  public:
 
-      @see The NEST simulator's librandom for a very flexible RNG interface
-      (http://www.nest-initiative.org).
+    /// Create stream at address (0, 0, 0) with seed 0.
+    RandomStream();
 
-      @ingroup toolbox
-  */
+    /** Create stream at given address.
+	@param seed   Seed; the key of the block function.
+	@param year   Simulation year.
+	@param phase  Part of the simulation year drawing the numbers.
+	@param entity Cell index, Animal handle or other id within the phase.
+    */
+    RandomStream(uint64_t seed, uint32_t year, uint32_t phase, uint32_t entity);
 
-  class RandomGenerator {
+    //! Draw 32 random bits
+    uint32_t next();
 
-  public:
-    
     //! Draw random number uniformly distributed on [0, 1)
     double drand();
 
     /** Draw integer random number uniformly distributed on [0, n)
-	@param n Upper limit, not include: numbers are chosen from 0, 1, ..., n-1
-	@throws domain_error if n is out of range
+	@param n Upper limit, not included: numbers are chosen from 0, 1, ..., n-1
     */
     unsigned int nrand(unsigned int n);
 
-    /** Access function.
-	@see Meyers, More Exceptional C++, Item 26, p 130, AW, 1996.
-    */
-    friend RandomGenerator& randomGen(unsigned int seed);
+    //! Number of 32 bit words drawn so far
+    uint64_t draws() const;
+
+    //! Write stream state in binary form
+    std::ostream& write(std::ostream &os) const;
+
+    //! Read stream state written by write()
+    std::istream& read(std::istream &is);
 
   private:
 
-    /** Create generator with given seed.
-	@param seed Seed value for the generator.
-	@throws domain_error if seed is out of range
-	@note No re-seeding is possible.
-	@note Private as consequence of singleton pattern.
+    uint32_t key_[2];  //!< Key of the block function.
+    uint32_t ctr_[4];  //!< Counter of the next block: (n, entity, year, phase).
+    uint32_t buf_[4];  //!< Current block.
+    unsigned int used_;  //!< Words of buf_ drawn; 4 if a new block is needed.
+
+  }; // class RandomStream
+
+
+  /** Random generator for use with BioSim.
+      The generator is counter based: it holds no sequence, only a seed
+      and the current simulation year, and hands out a RandomStream for
+      any (phase, entity) address. The numbers a part of the simulation
+      draws therefore depend only on the seed and on what is drawn at
+      its address, never on the order in which other parts run, which
+      keeps results bit-reproducible when work is spread over threads.
+
+      Any number of generators may exist, so several simulations can run
+      in one program. The state is the seed and the year; write() and
+      read() save and restore it.
+
+      @ingroup toolbox
+  */
+
+  class RandomGenerator {
+
+  public:
+
+    /// Create generator with given seed, at year 0.
+    explicit RandomGenerator(uint64_t seed = 0);
+
+    //! Set seed
+    void seed(uint64_t seed);
+
+    //! Return seed
+    uint64_t seed() const { return seed_; }
+
+    //! Set year used for addressing streams
+    void year(uint32_t year) { year_ = year; }
+
+    //! Return year used for addressing streams
+    uint32_t year() const { return year_; }
+
+    /** Return stream at given address in the current year.
+	@param phase  Part of the simulation year drawing the numbers.
+	@param entity Cell index, Animal handle or other id within the phase.
     */
-    RandomGenerator(unsigned int seed); 
+    RandomStream stream(uint32_t phase, uint32_t entity) const;
 
-    /// @note prohibit copying by making copy constructor private
-    RandomGenerator(const RandomGenerator&);
+    /** Return a single number, addressed directly.
+	@param phase  Part of the simulation year drawing the numbers.
+	@param entity Cell index, Animal handle or other id within the phase.
+	@param draw   Number of the draw at this address.
+	@return Random number uniformly distributed on [0, 1)
+    */
+    double drand(uint32_t phase, uint32_t entity, uint32_t draw) const;
+
+    /** Return one number for each of several entities, addressed directly.
+	Gives the same numbers as drand(phase, entities[i], draw) for each i.
+	@param phase    Part of the simulation year drawing the numbers.
+	@param entities Cell indices, Animal handles or other ids within the phase.
+	@param n        Number of entities.
+	@param draw     Number of the draw at each address.
+	@param u        Receives n random numbers uniformly distributed on [0, 1)
+    */
+    void drand(uint32_t phase, const uint32_t *entities, size_t n, uint32_t draw, double *u) const;
 
-    /// @note prohibit assignment by making operator private
-    RandomGenerator& operator=(const RandomGenerator&);
-    
-    /// @note Private as consequence of singleton pattern.
-    ~RandomGenerator() {}
+    //! Write generator state in binary form
+    std::ostream& write(std::ostream &os) const;
 
-  }; // class RandomGenerator
+    //! Read generator state written by write()
+    std::istream& read(std::istream &is);
 
+  private:
 
-  // -- Access function --------------------------------------------
+    uint64_t seed_;  //!< Seed.
+    uint32_t year_;  //!< Year.
 
-  /** Function providing access to the random generator.
-      This function provides controlled access to the single random
-      generator instance. On first call, the generator is created as a
-      static function variable. This first call MUST be with a seed
-      value as argument. The seed MUST differ from 0. All later calls
-      MUST be without argument.
-      @param seed non-zero, to be used on first call only
-      @throw logic_error if called without seed on first call or with
-      seed on later calls
-      @see Meyers, More Exceptional C++, Item 26, p 130, AW, 1996.
-  */
-  RandomGenerator& randomGen(unsigned int seed = 0);
+  }; // class RandomGenerator
 
-} // namespace toolbox 
+} // namespace toolbox
 
 
-// -- RandomGenerator function definitions -----------------------
+// -- RandomStream function definitions --------------------------
 
 /*
-  All random generator functions are implemented inline, except the constructor.
+  The drawing functions are implemented inline, the rest in random.cpp.
 */
 
 inline
-double toolbox::RandomGenerator::drand() 
+uint32_t toolbox::RandomStream::next()
 {
-  unsigned int r;
-
-  // rand() returns within [0, RAND_MAX], we want [0, 1)
-  do {
-    r = std::rand();
-  } while ( r == RAND_MAX );  
-
-  return r / static_cast<double>(RAND_MAX);
+  if ( used_ == 4 )
+  {
+    buf_[0] = ctr_[0]; buf_[1] = ctr_[1]; buf_[2] = ctr_[2]; buf_[3] = ctr_[3];
+    philox(buf_, key_);
+    ++ctr_[0];
+    used_ = 0;
+  }
+  return buf_[used_++];
 }
 
 inline
-unsigned int toolbox::RandomGenerator::nrand(unsigned int n) 
+double toolbox::RandomStream::drand()
 {
-  if ( n > RAND_MAX )
-    throw std::domain_error("toolbox::RandomGenerator::nrand(): Argument is out of range.");
-
-  // see ACC++, sec 7.4.4
-  const unsigned int scale = RAND_MAX / n;
-
-  unsigned int r;
-
-  do {
-    r = std::rand() / scale;
-  } while (r >= n); 
+  // 53 random bits, scaled to [0, 1)
+  const uint64_t hi = next() >> 5;
+  const uint64_t lo = next() >> 6;
+  return ((hi << 26) | lo) * (1.0 / 9007199254740992.0);
+}
 
-  return r;
+inline
+unsigned int toolbox::RandomStream::nrand(unsigned int n)
+{
+  // multiply-shift; the bias is below 2^-32 * n
+  return static_cast<unsigned int>((static_cast<uint64_t>(next()) * n) >> 32);
 }
 
 #endif
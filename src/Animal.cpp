@@ -14,7 +14,7 @@
 #include "Map.h"
 
 using BioSim::Animal;
-/** Writes a formatted report of the Animals in the vector, for .pop files:
+/** Writes a formatted report of the Animals in the range, for .pop files:
  *  @code
  *    3 4.21
  *    2 5.33
@@ -23,11 +23,28 @@ using BioSim::Animal;
  *  @param beasts The Animals to write.
  *  @return The stream that was written to.
  */
-std::ostream& BioSim::operator<< (std::ostream& os, const std::vector<Animal *> &beasts) {
-  std::vector<Animal*>::const_iterator iter = beasts.begin();
+std::ostream& BioSim::operator<< (std::ostream& os, const AnimalRange &beasts) {
+  AnimalRange::iterator iter = beasts.begin();
   while (iter != beasts.end()) {
+    Animal beast = *iter;
     os.precision(3);
-    os << std::setw(3) << (*iter)->alder() << std::setw(7) << std::fixed << (*iter)->weight() << std::endl;
+    os << std::setw(3) << beast.alder() << std::setw(7) << std::fixed << beast.weight() << std::endl;
+    iter++;
+  }
+  return os;
+}
+
+/** Writes a formatted report of the Animals in the vector, for .pop files, in the same format as for an AnimalRange.
+ *  @param os The stream to write to.
+ *  @param beasts The Animals to write.
+ *  @return The stream that was written to.
+ */
+std::ostream& BioSim::operator<< (std::ostream& os, const std::vector<Animal> &beasts) {
+  std::vector<Animal>::const_iterator iter = beasts.begin();
+  while (iter != beasts.end()) {
+    Animal beast = *iter;
+    os.precision(3);
+    os << std::setw(3) << beast.alder() << std::setw(7) << std::fixed << beast.weight() << std::endl;
     iter++;
   }
   return os;
@@ -42,7 +59,7 @@ std::ostream& BioSim::operator<< (std::ostream& os, const std::vector<Animal *>
  */
 double BioSim::func_q (double x,double x_half, double phi,bool pos) {
   double coeff = (pos?1.0:-1.0);
-  return 1 / (1 + exp(coeff * phi * (x - x_half)));
+  return 1 / (1 + expq(coeff * phi * (x - x_half)));
 }
 
 /// This function exists for debugging purposes only. Species never disappear.
@@ -58,88 +75,72 @@ bool Animal::operator> (Animal &b) {
   return (fitness() > b.fitness());
 }
 
-/** Compares two animal pointers by fitness. Utility function for collection<Animal*> sorting.
+/** Compares two animals by fitness. Utility function for collection<Animal> sorting.
  *  @param a The left-hand side.
  *  @param b The right-hand side.
  *  @return True if a > b.
  */
-bool BioSim::p_fit(Animal *a,Animal *b) {
-  return (*a) > (*b);
+bool BioSim::p_fit(Animal a,Animal b) {
+  return a > b;
+}
+
+/** Compares two animals by fitness, for sorting from the least fit.
+ *  @param a The left-hand side.
+ *  @param b The right-hand side.
+ *  @return True if a < b.
+ */
+bool BioSim::p_unfit(Animal a,Animal b) {
+  return a < b;
 }
 
-/** Utility function to partition vector<Animal*>.
- *  @param o A pointer to an Animal.
+/** Utility function to partition vector<Animal>.
+ *  @param o An Animal.
  *  @return False if the Animal is predatory.
  */
-bool BioSim::part_pred(Animal *o) {
-  return !(o->genus()->predator());
+bool BioSim::part_pred(Animal o) {
+  return !(o.genus()->predator());
 }
 
 /// @return The age of the Animal.
 int Animal::alder() {
-  return _alder;
+  return store->alder(id);
 }
 
 /// This function creates a zombie animal. This functions as a marker value for nonviable animals.
 Animal::Animal() {
-  _alder = 0;
-  _loci = NULL;
-  isa = NULL;
-  _fitness = ANIMAL_INV;
+  store = NULL;
+  id = ANIMAL_NONE;
 }
 
-/** Vivifies a viable animal. This Animal will have an age of 0 and a weight equal to the birthweight for the Species.
- *  @param type     A pointer to a Species.
- *  @param location A pointer to the Cell where the Animal should be.
- */
-Animal::Animal(BioSim::Species * type, BioSim::Cell*location) {
-  isa = type;
-  _vekt = isa->birthweight();
-  _loci = NULL;
-  moveTo(location);
-  _alder = 0;
-  _fitness = isa->fitness(_vekt, _alder);
-}
-
-/** Recreates a preexisting Animal.
- *  @param type     A pointer to Species.
- *  @param alder    The age of the new Animal.
- *  @param vekt     The weight of the new Animal.
- *  @param location A pointer to the Cell where the Animal should be.
+/** Refers to an Animal already created in an AnimalStore with AnimalStore::create().
+ *  @param store The store holding the Animal.
+ *  @param id    The slot of the Animal in store.
  */
-Animal::Animal(BioSim::Species * type, int alder, double vekt, BioSim::Cell*location) {
-  isa = type;
-  _vekt = vekt;
-  _alder = alder;
-  _loci = NULL;
-  moveTo(location);
-  _fitness = isa->fitness(_vekt, _alder);
+Animal::Animal(BioSim::AnimalStore *store, BioSim::AnimalHandle id) {
+  this->store = store;
+  this->id = id;
+}
+
+/// @return False for zombie animals and for animals that have been destroyed.
+bool Animal::valid() {
+  return store && store->valid(id);
 }
 
 /// @return The fitness for the Animal.
 double Animal::fitness() {
-  if (_fitness == ANIMAL_INV)
-    return _fitness = isa->fitness(_vekt, _alder);
-  return _fitness;
+  double &cache = store->fitness(id);
+  if (cache == ANIMAL_INV)
+    return cache = genus()->fitness(store->vekt(id), store->alder(id));
+  return cache;
 }
 
 /** Calculates if a beast of this Species would wander.
  *  @param beastPhi The fitness of the Animal.
+ *  @param rng      The random stream to draw from.
  *  @return True if the beast would wander.
  */
-bool BioSim::Species::willWander(double beastPhi) {
-  return (toolbox::randomGen().drand() < _mu*beastPhi);
-}
-
-/** This function checks if the Animal will wander, and where to.
- *  Additionally; the Animal will wander if it would.
- *  @return True if the Animal wandered.
- */
-bool Animal::wander() {
-  if (isa->willWander(fitness())) {
-    moveTo(_loci->neighbours()[toolbox::randomGen().nrand(4)]);
-    return true;
-  } return false;
+bool BioSim::Species::willWander(double beastPhi, toolbox::RandomStream &rng) {
+  return (rng.drand() < _mu*beastPhi);
 }
 
 /** This function moves the Animal.
@@ -149,25 +150,28 @@ bool Animal::wander() {
  */
 bool Animal::moveTo(BioSim::Cell *destination) {
   if (!destination) return false;
-  if (destination->addAnimal(this)) {
-    if (_loci && _loci != destination) {
-      _loci->removeAnimal(this);
-    } _loci = destination;
+  BioSim::Cell *loci = location();
+  if (loci == destination) return true;
+  if (destination->addAnimal()) {
+    if (loci) {
+      loci->removeAnimal(*this); // Must precede addAnimal(), which records the Animal's new place.
+    }
+    destination->addAnimal(*this);
+    store->loci(id) = destination->index();
     return true;
   } return false;
 }
 
-/** Causes the Animal to attempt to breed.
- *  @return An pointer to an Animal instance, or @c NULL if the breeding was unsuccessful.
+/** Performs the parent's part of breeding: if the Animal is able to, it loses its birth weight. Creating the newborn is left
+ *  to the caller, so that this may run while other threads breed in other Cells.
+ *  @return True if a newborn should be created.
  */
-Animal *Animal::breed() {
-  if (_alder && isa->canBreed(_vekt)) {
-    _vekt -= isa->birthloss();
-    _fitness = ANIMAL_INV;
-    return new Animal(isa,_loci);
-  } else {
-    return NULL;
-  }
+bool Animal::conceive() {
+  Species *isa = genus();
+  if (!(store->alder(id) && isa->canBreed(store->vekt(id)))) return false;
+  store->vekt(id) -= isa->birthloss();
+  store->fitness(id) = ANIMAL_INV;
+  return true;
 }
 
 /** Adjusts the weight and age of the Animal. This causes the fitness cache to be reset.
@@ -175,47 +179,46 @@ Animal *Animal::breed() {
  *  @param vekt  The target weight of the Animal.
  */
 void Animal::adjust(int alder, double vekt) {
-  _alder = alder;
-  _vekt = vekt;
-  _fitness = ANIMAL_INV;
-}
-
-/// This function ages the animal and causes it to lose its yearly weight.
-void Animal::age() {
-  _alder++;
-  _vekt = _vekt - isa->weightloss(_vekt);
-  _fitness = ANIMAL_INV;
+  BioSim::Cell *loci = location();
+  bool regroup = loci && ((store->alder(id) == 0) != (alder == 0)); // Cells keep Animals of age 0 apart from the breeders.
+  if (regroup) loci->removeAnimal(*this);
+  store->alder(id) = alder;
+  store->vekt(id) = vekt;
+  store->fitness(id) = ANIMAL_INV;
+  if (regroup) loci->addAnimal(*this);
 }
 
 /** This function causes the Animal to attempt to feed.
  *  @return A vector with pointers to animals. If a herbivore fed; this vector will only contain same Animal; for predatory Animals, the vector will contain pointers to the eaten animals.
  */
-std::vector<Animal*> Animal::feed() {
-  return isa->feed(this);
+std::vector<Animal> Animal::feed() {
+  return genus()->feed(*this);
 }
 
-/// Destructs the Animal and removes it from its Cell.
-Animal::~Animal() {
-  isa = NULL;
-  if (_loci) _loci->removeAnimal(this);
+/** This function causes the Animal to attempt to feed, without allocating a new result vector.
+ *  @param food Cleared, then filled as the return value of BioSim::Animal::feed().
+ */
+void Animal::feed(std::vector<Animal> &food) {
+  genus()->feed(*this, food);
 }
 
 /** This function increases the weight of the Animal.
  *  @param delta_w The ammount by which the Animal should fatten.
  */
 void Animal::fatten(double delta_w) {
-  _vekt += delta_w;
-  _fitness = ANIMAL_INV;
+  store->vekt(id) += delta_w;
+  store->fitness(id) = ANIMAL_INV;
 }
 
-/** This function causes the Animal to attempt to eat a prey Animal.
- *  @param prey A pointer to the Animal to eat.
+/** This function causes the Animal to attempt to eat a prey Animal. The chance is drawn from the random stream of the Animal's Cell,
+ *  so that predation in one Cell does not depend on any other Cell.
+ *  @param prey The Animal to eat.
  *  @return True if prey was eaten.
  */
-bool Animal::eat(Animal* prey) {
+bool Animal::eat(Animal prey) {
   double phi_pred = this->fitness();
-  double phi_prey = prey->fitness();
-  double delta_phi_max = isa->deltaPhiMax();
+  double phi_prey = prey.fitness();
+  double delta_phi_max = genus()->deltaPhiMax();
   double delta_phi = phi_pred - phi_prey;
 
   double catch_chance;
@@ -228,7 +231,7 @@ bool Animal::eat(Animal* prey) {
     catch_chance = 1.0;
   }
 
-  bool eaten = (toolbox::randomGen().drand() < catch_chance);
+  bool eaten = (location()->random().drand() < catch_chance);
   return eaten;
 }
 
@@ -236,51 +239,92 @@ bool Animal::eat(Animal* prey) {
  *  @param beast The animal attempting to feed.
  *  @return A vector of pointers to Animals. For herbivores; this vector will only contain @c beast, whereas for predators it will contain pointers to the consumed Animals.
  */
-std::vector<Animal*> BioSim::Species::feed(Animal *beast) {
-  std::vector<Animal*> retval;
+std::vector<Animal> BioSim::Species::feed(Animal beast) {
+  std::vector<Animal> retval;
+  feed(beast, retval);
+  return retval;
+}
+
+/** This function causes the Animal to attempt feeding, reusing a result buffer so that no memory is allocated once the buffer has grown.
+ *  Prey that is eaten is marked with BioSim::Animal::kill() at once, so that it is skipped by later predators, but it stays in its Cell;
+ *  removing it is left to the caller.
+ *  @param beast The animal attempting to feed.
+ *  @param food  Cleared, then filled as the return value of BioSim::Species::feed(Animal).
+ */
+void BioSim::Species::feed(Animal beast, std::vector<Animal> &food) {
+  std::vector<Animal> &retval = food;
+  retval.clear();
 
   if (predatory) { // For predatory Animals
-    std::vector<Animal*> cellmates = beast->location()->animals();
-    std::vector<Animal*>::iterator iter = cellmates.begin();
-    while (iter != cellmates.end()) {
-      if ((*iter)->genus() != beast->genus() && (*iter)->weight()) {
-        if (beast->eat(*iter)) {
-          beast->fatten(_beta*(*iter)->weight());
-          retval.push_back(*iter);
+    BioSim::Cell *loci = beast.location();
+    unsigned short own = beast.genusId();
+    // Eaten Animals stay in the Cell until the caller removes them, so the buckets do not change while they are traversed.
+    for (unsigned short genus = 0; genus < loci->genera(); genus++) {
+      if (genus == own) continue;
+      AnimalRange cellmates = loci->inhabitants(genus);
+      for (AnimalRange::iterator iter = cellmates.begin(); iter != cellmates.end(); iter++) {
+        Animal prey = *iter;
+        if (!prey.dead() && beast.eat(prey)) {
+          beast.fatten(_beta*prey.weight());
+          prey.kill();
+          retval.push_back(prey);
         }
       }
-      iter++;
     }
   } else { // For herbivores
-    double grass = beast->location()->graze(_F);
-    beast->fatten(_beta*grass);
+    double grass = beast.location()->graze(_F);
+    beast.fatten(_beta*grass);
     retval.push_back(beast);
   }
-
-  return retval;
 }
 
-/** This function determines wether the Animal dies.
- *  @return True if the Animal dies.
+/** Predation with early exit. The herbivores of the Cell are given from the least to the most fit, and the predator tries them in
+ *  that order until it meets one at least as fit as itself, which it could not catch; BioSim::Animal::eat() draws no random number
+ *  for the ones not tried. Predators of other species are then tried as in BioSim::Species::feed().
+ *  @param beast   The predator.
+ *  @param prey    The herbivores of the predator's Cell, sorted with BioSim::p_unfit() after they have fed.
+ *  @param weakest The position in @c prey before which all herbivores have been eaten. Shared by the predators of the Cell and
+ *                 advanced past eaten herbivores, so that the prefix eaten by earlier predators is not scanned again.
+ *  @param food    Cleared, then filled with the Animals eaten.
  */
-bool Animal::die() {
-  bool death = false;
-  if (_vekt == 0 || (isa->die(fitness()))) death = true;
-  if (death) {
-    if (_loci) _loci->removeAnimal(this);
-    _loci = NULL;
+void BioSim::Species::hunt(Animal beast, std::vector<Animal> &prey, size_t &weakest, std::vector<Animal> &food) {
+  food.clear();
+  while (weakest < prey.size() && prey[weakest].dead()) weakest++;
+  for (size_t i = weakest; i < prey.size(); i++) {
+    Animal target = prey[i];
+    if (target.fitness() >= beast.fitness()) break;
+    if (!target.dead() && beast.eat(target)) {
+      beast.fatten(_beta*target.weight());
+      target.kill();
+      food.push_back(target);
+    }
+  }
+  BioSim::Cell *loci = beast.location();
+  unsigned short own = beast.genusId();
+  for (unsigned short genus = 0; genus < loci->genera(); genus++) {
+    if (genus == own || !loci->headcount(genus) || !loci->habitant(genus, 0).genus()->predator()) continue;
+    AnimalRange cellmates = loci->inhabitants(genus);
+    for (AnimalRange::iterator iter = cellmates.begin(); iter != cellmates.end(); iter++) {
+      Animal target = *iter;
+      if (!target.dead() && beast.eat(target)) {
+        beast.fatten(_beta*target.weight());
+        target.kill();
+        food.push_back(target);
+      }
+    }
   }
-  return death;
 }
 
-/** Calculates if the Animal dies.
+/** Calculates if an Animal of this Species dies of old age or poor fitness. An Animal of weight 0 always dies; that is left to
+ *  the caller. The random number is taken as an argument, so that the caller may draw them in bulk.
  *  @param beastPhi The fitness of the Animal.
+ *  @param draw     A random number, uniform on [0, 1).
  *  @return True if the Animal dies.
  */
-bool BioSim::Species::die(double beastPhi) {
+bool BioSim::Species::die(double beastPhi, double draw) {
   if (beastPhi <= 0.0) return true;
   double death = _omega * (1 - beastPhi);
-  return (toolbox::randomGen().drand() < death);
+  return (draw < death);
 }
 
 /// @return The ∆Φ<sub>max</sub> of the Species.
@@ -328,20 +372,109 @@ void BioSim::Species::init (const std::string &params) {
   if (name == "") {
     name = (predatory?"R":"B");
   }
+  shape();
+}
+
+/// The age table is rebuilt, and any weight table dropped; see BioSim::Species::tabulate().
+void BioSim::Species::shape() {
+  _curve.v_min = _v_min;
+  _curve.a_halv = _a_halv;
+  _curve.k_alder = _phi_alder;
+  _curve.v_halv_under = _v_halv_under;
+  _curve.k_under = -_phi_under;
+  _curve.v_halv_over = _v_halv_over;
+  _curve.k_over = _phi_over;
+  _curve.tabulate();
+}
+
+/** @param os A binary output stream.
+ *  @return os.
+ */
+std::ostream &BioSim::Species::write(std::ostream &os) {
+  unsigned int length = name.size();
+  char kind = predatory;
+  os.write((const char *) &length, sizeof(length));
+  os.write(name.data(), length);
+  os.write(&kind, 1);
+  os.write((const char *) &_a_halv, sizeof(_a_halv));
+  const double *params[] = {&_v_fod, &_beta, &_sigma, &_v_min, &_phi_alder, &_v_halv_under, &_phi_under, &_v_halv_over,
+                            &_phi_over, &_mu, &_gamma, &_zeta, &_omega, &_F, &_DeltaPhiMax};
+  for (size_t i = 0; i < sizeof(params) / sizeof(params[0]); i++) os.write((const char *) params[i], sizeof(double));
+  return os;
+}
+
+/** The parameters replace those read by init(), and the fitness tables are rebuilt exact; see BioSim::Species::tabulate().
+ *  @param is A binary input stream, positioned at data from write().
+ *  @return is.
+ */
+std::istream &BioSim::Species::read(std::istream &is) {
+  unsigned int length = 0;
+  is.read((char *) &length, sizeof(length));
+  if (!is || length > 4096) throw std::runtime_error("Species::read(): corrupt data.");
+  std::string genus(length, ' ');
+  char kind = 0;
+  is.read(&genus[0], length);
+  is.read(&kind, 1);
+  is.read((char *) &_a_halv, sizeof(_a_halv));
+  double *params[] = {&_v_fod, &_beta, &_sigma, &_v_min, &_phi_alder, &_v_halv_under, &_phi_under, &_v_halv_over,
+                      &_phi_over, &_mu, &_gamma, &_zeta, &_omega, &_F, &_DeltaPhiMax};
+  for (size_t i = 0; i < sizeof(params) / sizeof(params[0]); i++) is.read((char *) params[i], sizeof(double));
+  if (!is) throw std::runtime_error("Species::read(): truncated data.");
+  name = genus;
+  predatory = kind;
+  shape();
+  return is;
+}
+
+/** The fitness parameters are set up again, with exact weight factors; see BioSim::Species::tabulate(). Whether the Species is a
+ *  predator is decided by init(), and is not changed.
+ *  @param key   The keyword of the parameter in the .par file, such as @c mu or @c a_halv.
+ *  @param value The new value; rounded for @c a_halv.
+ *  @return False if there is no parameter with that keyword.
+ */
+bool BioSim::Species::parameter(const std::string &key, double value) {
+  const char *keys[] = {"v_fod", "beta", "sigma", "v_min", "phi_alder", "v_halv_under", "phi_under", "v_halv_over",
+                        "phi_over", "mu", "gamma", "zeta", "omega", "F", "DeltaPhiMax"};
+  double *params[] = {&_v_fod, &_beta, &_sigma, &_v_min, &_phi_alder, &_v_halv_under, &_phi_under, &_v_halv_over,
+                      &_phi_over, &_mu, &_gamma, &_zeta, &_omega, &_F, &_DeltaPhiMax};
+  if (key == "a_halv") {
+    _a_halv = (int) floor(value + 0.5);
+  } else {
+    size_t i = 0;
+    while (i < sizeof(keys) / sizeof(keys[0]) && key != keys[i]) i++;
+    if (i == sizeof(keys) / sizeof(keys[0])) return false;
+    *params[i] = value;
+  }
+  shape();
+  return true;
+}
+
+/** Replaces the exact weight factors of the fitness function by an interpolated table; see FitnessCurve::tabulate(double).
+ *  @param tolerance The largest acceptable error in the fitness, or 0 for exact weight factors.
+ *  @return The largest error found.
+ */
+double BioSim::Species::tabulate(double tolerance) {
+  return _curve.tabulate(tolerance);
+}
+
+/// @return The number of points in the weight table; 0 if the weight factors are exact.
+unsigned int BioSim::Species::weightPoints() {
+  return _curve.q_vekt.size();
+}
+
+/// @return The largest deviation of the fitness tables from the func_q() definition.
+double BioSim::Species::deviation() {
+  return _curve.deviation();
 }
 
 /** Caluclates the fitness of an Animal of this Species given weight and age.
+ *  The result is the same as that of AnimalStore::refreshFitness() for the same Animal.
  *  @param weight The weight of the Animal.
  *  @param age The age of the Animal.
  *  @return The fitness of the Animal.
  */
 double BioSim::Species::fitness(double weight, int age) {
-  if (weight < _v_min) return 0.0;
-  return (
-    func_q(age,   _a_halv,      _phi_alder,  true) *
-    func_q(weight,_v_halv_under,_phi_under, false) *
-    func_q(weight,_v_halv_over, _phi_over,   true)
-  );
+  return BioSim::fitness(_curve, weight, age);
 }
 
 /** This function calculates if an Animal of this Species can breed.
@@ -352,9 +485,11 @@ bool BioSim::Species::canBreed(double weight) {
   return (weight >= (_v_min + birthloss()));
 }
 
-/// @return A pointer to the Cell representing the location of the Animal.
+/// @return A pointer to the Cell representing the location of the Animal, or @c NULL if it has none.
 BioSim::Cell* Animal::location() {
-  return _loci;
+  unsigned int loci = store->loci(id);
+  if (loci == CELL_NONE) return NULL;
+  return store->geography()->cell(loci);
 }
 
 /** This function returns the chance of an Animal of species @c this breeding given @c largeN cellmates.
@@ -362,8 +497,8 @@ BioSim::Cell* Animal::location() {
  *  @param largeN The number of other beasts of the same Species in the same cell.
  *  @return The chance of @c beast breeding.
  */
-double BioSim::Species::birthChance(Animal *beast,int largeN) {
-  return (beast->fitness() * _gamma * (largeN -1));
+double BioSim::Species::birthChance(Animal beast,int largeN) {
+  return (beast.fitness() * _gamma * (largeN -1));
 }
 
 /** This function calculates the yearly weightloss of an Animal of this Species.
@@ -398,10 +533,23 @@ bool BioSim::Species::predator() {
 
 /// @return A pointer to the Species of this Animal.
 BioSim::Species *Animal::genus() {
-  return isa;
+  return store->species(store->genus(id));
+}
+
+/// @return The species id of this Animal, as numbered by its AnimalStore.
+unsigned short Animal::genusId() {
+  return store->genus(id);
 }
 
 /// @return The weight of this Animal.
 double Animal::weight() {
-  return _vekt;
+  return store->vekt(id);
+}
+
+/** The Animal is given weight 0, and with it fitness 0, which serves as its tombstone: it can neither be eaten again nor feed,
+ *  and dies at the latest in the next death sweep. Its Cell is not touched, so that Cells can be traversed while Animals are killed.
+ */
+void Animal::kill() {
+  store->vekt(id) = 0.0;
+  store->fitness(id) = 0.0;
 }
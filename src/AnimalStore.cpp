@@ -0,0 +1,288 @@
+/** @file AnimalStore.cpp
+ *  @brief This file contains the definition of the AnimalStore class.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#include "AnimalStore.h"
+#include "Animal.h"
+#include "Map.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+/// Initial number of slots in an AnimalStore.
+#define STORE_MIN_CAPACITY 4096
+
+/// Rounds a column size up to a whole cache line.
+#define STORE_ALIGN(bytes) (((bytes) + 63) & ~(size_t)63)
+
+using BioSim::AnimalStore;
+
+/// Creates an empty store. A Map must be set with geography() before any Animal is placed in a Cell.
+AnimalStore::AnimalStore() {
+  _genus = NULL;
+  _alder = NULL;
+  _vekt = NULL;
+  _fitness = NULL;
+  _loci = NULL;
+  _place = NULL;
+  _slots = 0;
+  _capacity = 0;
+  _free = ANIMAL_NONE;
+  _hugePages = false;
+  _geography = NULL;
+  _count = 0;
+}
+
+/** Huge pages reduce TLB pressure for very large populations. The setting takes effect the next time the Arena is
+ *  allocated, so it should be given before the population is read.
+ *  @param enable True to request huge pages.
+ */
+void AnimalStore::hugePages(bool enable) {
+  _hugePages = enable;
+}
+
+/// @param capacity The number of slots to make room for.
+void AnimalStore::reserve(unsigned int capacity) {
+  if (capacity > _capacity) grow(capacity);
+}
+
+/** Allocates a new Arena, lays the columns out in it, copies the slots in use and releases the old Arena.
+ *  @param capacity The number of slots in the new Arena.
+ */
+void AnimalStore::grow(unsigned int capacity) {
+  size_t wide  = STORE_ALIGN(capacity * sizeof(double));
+  size_t word  = STORE_ALIGN(capacity * sizeof(unsigned int));
+  size_t half  = STORE_ALIGN(capacity * sizeof(unsigned short));
+  Arena fresh(2 * wide + 3 * word + half, _hugePages);
+  char *base = fresh.base();
+  double *vekt            = (double *) base;
+  double *fitness         = (double *) (base + wide);
+  unsigned int *loci      = (unsigned int *) (base + 2 * wide);
+  unsigned int *place     = (unsigned int *) (base + 2 * wide + word);
+  int *alder              = (int *) (base + 2 * wide + 2 * word);
+  unsigned short *genus   = (unsigned short *) (base + 2 * wide + 3 * word);
+  if (_slots) {
+    memcpy(vekt,    _vekt,    _slots * sizeof(double));
+    memcpy(fitness, _fitness, _slots * sizeof(double));
+    memcpy(loci,    _loci,    _slots * sizeof(unsigned int));
+    memcpy(place,   _place,   _slots * sizeof(unsigned int));
+    memcpy(alder,   _alder,   _slots * sizeof(int));
+    memcpy(genus,   _genus,   _slots * sizeof(unsigned short));
+  }
+  _arena.swap(fresh); // The old Arena is unmapped as fresh goes out of scope.
+  _vekt = vekt;
+  _fitness = fitness;
+  _loci = loci;
+  _place = place;
+  _alder = alder;
+  _genus = genus;
+  _capacity = capacity;
+}
+
+/** All slots are released by unmapping the Arena; the cost does not depend on the number of Animals.
+ *  The Cells of the Map are not informed, so this should only be used when the Map is discarded or emptied as well.
+ */
+void AnimalStore::clear() {
+  _arena.reset();
+  _genus = NULL;
+  _alder = NULL;
+  _vekt = NULL;
+  _fitness = NULL;
+  _loci = NULL;
+  _place = NULL;
+  _slots = 0;
+  _capacity = 0;
+  _free = ANIMAL_NONE;
+  _count = 0;
+}
+
+/// @param map The Map whose Cell indices are recorded in the Cell index column.
+void AnimalStore::geography(BioSim::Map *map) {
+  _geography = map;
+}
+
+/** Species are numbered in the order they are added; this number is what the species column holds.
+ *  @param genus A pointer to the Species to register.
+ *  @return The id of the Species.
+ */
+unsigned short AnimalStore::addSpecies(BioSim::Species *genus) {
+  if (_species.size() >= SPECIES_NONE)
+    throw std::runtime_error("AnimalStore::addSpecies(): too many species.");
+  _species.push_back(genus);
+  return _species.size() - 1;
+}
+
+/** @param genus A pointer to a registered Species.
+ *  @return The id of the Species, or SPECIES_NONE if it is not registered.
+ */
+unsigned short AnimalStore::speciesId(BioSim::Species *genus) {
+  for (unsigned short i = 0; i < _species.size(); i++) {
+    if (_species[i] == genus) return i;
+  }
+  return SPECIES_NONE;
+}
+
+/** The new Animal is not located in any Cell; it should be placed with Animal::moveTo().
+ *  The most recently freed slot is reused first; the columns are only extended when the free list is empty.
+ *  @param genus The species id of the new Animal.
+ *  @param alder The age of the new Animal.
+ *  @param vekt  The weight of the new Animal.
+ *  @return The handle of the new Animal.
+ */
+BioSim::AnimalHandle AnimalStore::create(unsigned short genus, int alder, double vekt) {
+  AnimalHandle beast;
+  allocate(1, &beast);
+  emplace(beast, genus, alder, vekt);
+  return beast;
+}
+
+/** Slots are taken in the order n calls to create() would take them, so handing out the slots in bulk does not change which
+ *  Animal gets which handle. The columns are grown at most once.
+ *  The slots are not valid() until filled with emplace(), which may be done concurrently for distinct slots.
+ *  Handles are below ANIMAL_NONE; if there are not that many slots, nothing is taken and an exception is thrown.
+ *  @param n       The number of slots.
+ *  @param beasts  Receives the handles of the slots.
+ */
+void AnimalStore::allocate(size_t n, BioSim::AnimalHandle *beasts) {
+  size_t reused = _slots - _count; // The length of the free list.
+  size_t fresh = n > reused ? n - reused : 0;
+  if (fresh > (size_t) ANIMAL_NONE - _slots)
+    throw std::runtime_error("AnimalStore::allocate(): too many Animals.");
+  size_t i = 0;
+  for (; i < n && _free != ANIMAL_NONE; i++) {
+    beasts[i] = _free;
+    _free = _loci[_free];
+  }
+  if (_slots + fresh > _capacity) {
+    size_t capacity = _capacity ? _capacity : STORE_MIN_CAPACITY;
+    while (capacity < _slots + fresh) capacity *= 2;
+    grow(std::min(capacity, (size_t) ANIMAL_NONE));
+  }
+  for (; i < n; i++) {
+    _genus[_slots] = SPECIES_NONE; // Not valid() until emplace().
+    beasts[i] = _slots++;
+  }
+  _count += n;
+}
+
+/** The new Animal is not located in any Cell; it should be placed with Animal::moveTo().
+ *  @param beast The handle of a slot from allocate().
+ *  @param genus The species id of the new Animal.
+ *  @param alder The age of the new Animal.
+ *  @param vekt  The weight of the new Animal.
+ */
+void AnimalStore::emplace(BioSim::AnimalHandle beast, unsigned short genus, int alder, double vekt) {
+  _genus[beast]   = genus;
+  _alder[beast]   = alder;
+  _vekt[beast]    = vekt;
+  _fitness[beast] = ANIMAL_INV;
+  _loci[beast]    = CELL_NONE;
+}
+
+/** Destroying an invalid handle does nothing.
+ *  @param beast The handle of the Animal to destroy.
+ */
+void AnimalStore::destroy(BioSim::AnimalHandle beast) {
+  if (!valid(beast)) return;
+  if (_loci[beast] != CELL_NONE)
+    _geography->cell(_loci[beast])->removeAnimal(Animal(this, beast));
+  _genus[beast] = SPECIES_NONE;
+  _loci[beast] = _free;
+  _free = beast;
+  _count--;
+}
+
+/** The columns are written raw, free slots and free list included, so that read() restores the very same handles and the
+ *  free list continues to hand out slots in the same order.
+ *  @param os A binary output stream.
+ *  @return os.
+ */
+std::ostream &AnimalStore::write(std::ostream &os) {
+  os.write((const char *) &_slots, sizeof(_slots));
+  os.write((const char *) &_free, sizeof(_free));
+  os.write((const char *) &_count, sizeof(_count));
+  if (!_slots) return os;
+  os.write((const char *) _genus,   _slots * sizeof(unsigned short));
+  os.write((const char *) _alder,   _slots * sizeof(int));
+  os.write((const char *) _vekt,    _slots * sizeof(double));
+  os.write((const char *) _fitness, _slots * sizeof(double));
+  os.write((const char *) _loci,    _slots * sizeof(unsigned int));
+  os.write((const char *) _place,   _slots * sizeof(unsigned int));
+  return os;
+}
+
+/** The Cells of the Map are not informed; see BioSim::Map::resettle().
+ *  @param is A binary input stream, positioned at data from write().
+ *  @return is.
+ */
+std::istream &AnimalStore::read(std::istream &is) {
+  unsigned int slots;
+  AnimalHandle free;
+  unsigned int count;
+  is.read((char *) &slots, sizeof(slots));
+  is.read((char *) &free, sizeof(free));
+  is.read((char *) &count, sizeof(count));
+  if (!is) throw std::runtime_error("AnimalStore::read(): truncated data.");
+  clear();
+  reserve(slots ? slots : STORE_MIN_CAPACITY);
+  if (slots) {
+    is.read((char *) _genus,   slots * sizeof(unsigned short));
+    is.read((char *) _alder,   slots * sizeof(int));
+    is.read((char *) _vekt,    slots * sizeof(double));
+    is.read((char *) _fitness, slots * sizeof(double));
+    is.read((char *) _loci,    slots * sizeof(unsigned int));
+    is.read((char *) _place,   slots * sizeof(unsigned int));
+  }
+  if (!is) throw std::runtime_error("AnimalStore::read(): truncated data.");
+  _slots = slots;
+  _free = free;
+  _count = count;
+  for (AnimalHandle beast = 0; beast < _slots; beast++) {
+    if (_genus[beast] != SPECIES_NONE && _genus[beast] >= _species.size())
+      throw std::runtime_error("AnimalStore::read(): unknown species id.");
+  }
+  return is;
+}
+
+/** Used when the fitness parameters of the species change; the values are computed again when next read.
+ *  @param genus The species id.
+ */
+void AnimalStore::forgetFitness(unsigned short genus) {
+  for (AnimalHandle beast = 0; beast < _slots; beast++) {
+    if (_genus[beast] == genus) _fitness[beast] = ANIMAL_INV;
+  }
+}
+
+/** The weights and ages of the stale Animals are copied into contiguous arrays and the batch fitness function applied to them
+ *  in one call; the results are exactly those Animal::fitness() would give. Only the given Animals are touched, so different
+ *  threads may refresh disjoint sets of Animals, each with its own scratch.
+ *  @param genus   The species id of the Animals.
+ *  @param beasts  The handles of the Animals; those whose fitness is not stale are skipped.
+ *  @param n       The number of handles.
+ *  @param scratch Space for the batch; grown as needed.
+ *  @return The number of fitness values computed.
+ */
+unsigned int AnimalStore::refreshFitness(unsigned short genus, const AnimalHandle *beasts, size_t n, std::vector<double> &scratch) {
+  if (scratch.size() < 4 * n) scratch.resize(4 * n);
+  double *vekt = scratch.data();
+  double *alder = vekt + n;
+  double *phi = alder + n;
+  double *slot = phi + n; // Handles are kept as doubles; every handle is exact in a double.
+  size_t stale = 0;
+  for (size_t i = 0; i < n; i++) {
+    AnimalHandle beast = beasts[i];
+    if (_fitness[beast] != ANIMAL_INV) continue;
+    vekt[stale] = _vekt[beast];
+    alder[stale] = _alder[beast];
+    slot[stale] = beast;
+    stale++;
+  }
+  if (!stale) return 0;
+  BioSim::fitness(_species[genus]->curve(), vekt, alder, phi, stale);
+  for (size_t i = 0; i < stale; i++) _fitness[(AnimalHandle) slot[i]] = phi[i];
+  return stale;
+}
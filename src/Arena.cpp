@@ -0,0 +1,67 @@
+/** @file Arena.cpp
+ *  @brief This file contains the definition of the Arena class.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#include "Arena.h"
+#include <stdexcept>
+#include <algorithm>
+
+#include <sys/mman.h>
+
+/// Size used to round up huge page mappings; 2 MiB is the common huge page size.
+#define ARENA_HUGE_PAGE (2u << 20)
+
+using BioSim::Arena;
+
+Arena::Arena() {
+  _base = NULL;
+  _size = 0;
+}
+
+/** @param bytes     The minimum size of the Arena.
+ *  @param hugePages If true, the Arena is backed by huge pages where the system allows it.
+ */
+Arena::Arena(size_t bytes, bool hugePages) {
+  _base = NULL;
+  _size = 0;
+  if (!bytes) return;
+  void *region = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (hugePages) {
+    size_t hugeBytes = (bytes + ARENA_HUGE_PAGE - 1) & ~(size_t)(ARENA_HUGE_PAGE - 1);
+    region = mmap(NULL, hugeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (region != MAP_FAILED) bytes = hugeBytes;
+  }
+#endif
+  if (region == MAP_FAILED) {
+    region = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+      throw std::runtime_error("Arena::Arena(): memory could not be mapped.");
+#ifdef MADV_HUGEPAGE
+    if (hugePages) madvise(region, bytes, MADV_HUGEPAGE); // Advisory only; failure is harmless.
+#endif
+  }
+  _base = region;
+  _size = bytes;
+}
+
+Arena::~Arena() {
+  reset();
+}
+
+/// Everything stored in the Arena is discarded; no destructors are run.
+void Arena::reset() {
+  if (_base) munmap(_base, _size);
+  _base = NULL;
+  _size = 0;
+}
+
+/// @param other The Arena to exchange mappings with.
+void Arena::swap(Arena &other) {
+  std::swap(_base, other._base);
+  std::swap(_size, other._size);
+}
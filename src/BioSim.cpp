@@ -10,15 +10,25 @@
 #include <fstream>
 #include <iomanip>
 #include "read_parameters.h"
-#include "skip_comment.h"
 #include "random.h"
 #include "filename.h"
 #include <cstdlib>
 #include <algorithm>
+#include <sstream>
+#include <memory>
+#include <cstdio>
+#include <stdint.h>
+#include <zlib.h>
 
 #include <sys/stat.h>
+#include <unistd.h>
 
-BioSim::Simulation::Simulation() : param_reader_(COMMENT_CHAR) {
+/// Identifies a BioSim checkpoint file.
+#define CHECKPOINT_MAGIC "BioSimCK"
+/// The checkpoint format version; files of other versions are refused.
+#define CHECKPOINT_VERSION 1
+
+BioSim::Simulation::Simulation() : thread_override(0), fitness_tolerance(0.0), fitness_check(0), param_reader_(COMMENT_CHAR) {
   param_reader_.register_param("Geografi", _geography);
   param_reader_.register_param("CelleParameter", _cells,std::string(""));
   param_reader_.register_param("CelleSpec",_cellSpec,std::string(""));
@@ -34,27 +44,33 @@ BioSim::Simulation::Simulation() : param_reader_(COMMENT_CHAR) {
   param_reader_.register_param("DumpPopInterval", inter_pop,0);
   param_reader_.register_param("DumpForInterval", inter_feed,0);
   param_reader_.register_param("DumpPNGInterval", inter_png,0); // This is included for compatibility; if compiled without PNG support, the keyword in .sim files will simply be ignored.
+  param_reader_.register_param("DumpChkInterval", inter_chk,0);
+  param_reader_.register_param("KomprimerChk", compress_chk,0);
+  param_reader_.register_param("RapportTraader", report_threads,1);
+  param_reader_.register_param("PNGProfil", png_profile_name,std::string("arkiv"));
+  param_reader_.register_param("PNGTraader", png_threads,1);
+  param_reader_.register_param("StoreSider", huge_pages,0);
+  param_reader_.register_param("Traader", threads,1);
+  param_reader_.register_param("FitnessToleranse", fitness_tolerance,0.0);
+  param_reader_.register_param("FitnessKontroll", fitness_check,0);
+  param_reader_.register_param("SortertJakt", sorted_hunt,0);
+  animals.geography(&geography);
 }
 
 BioSim::Simulation::~Simulation() {
   closeReport_dat(); // Just in case
-  std::set<Animal *>::iterator iter;
-  iter = animals.begin();
-  while (iter != animals.end()) {
-    delete (*iter);
-    iter++;
-  }
 }
 
 /// @param parameters A filename containing the .sim file.
 void BioSim::Simulation::init(const std::string &parameters) {
   param_reader_.read(parameters);  // reads file & sets values
-  try {
-    toolbox::randomGen(randseed);
-  }
-  catch ( std::logic_error &e) { // fixes a quasi-bug in the RandomGenereator class, required for multiple simulations
-    srand(randseed);
-  }
+  rng.seed(randseed);
+  if (thread_override > 0) threads = thread_override;
+  startThreads();
+#ifdef BIOSIM_PNG
+  png_profile = pngProfile(png_profile_name);
+#endif
+  animals.hugePages(huge_pages);
   if (_cells != std::string("")) {
     initGeo(_cells,_geography);
   } else if (_cellSpec != std::string("")) {
@@ -69,20 +85,90 @@ void BioSim::Simulation::init(const std::string &parameters) {
 
   std::list<std::string>::iterator iter = genera.begin();
   while (iter != genera.end()) {
-    initSpecies(*iter);
+    allSpecies.push_back(initSpecies(*iter));
     iter++;
   }
 
-  // Reads and vivifies populæ from .pop files.
-  iter = populae.begin();
-  while (iter != populae.end()) {
-    readPopulation(*iter);
-    iter++;
+  // Reads and vivifies populæ from .pop files. A checkpoint holds the Animals itself, and its species are checked against the
+  // .sim file by readCheckpoint(), so the .pop files need not exist when resuming.
+  if (_resume.empty()) readPopulations(populae);
+
+  tiles.resize(geography.tiles());
+  litters.resize(geography.mapView(true).size());
+  firstborn.resize(litters.size());
+  recount();
+
+  createOutputDir();
+
+  if (_resume.empty()) { // The .dat report is started by run().
+    _year = year_begin;
+    return;
   }
+  // The .dat report is cut back to where it was when the checkpoint was written, and continued from there.
+  long long datLength;
+  readCheckpoint(_resume, datLength);
+  std::string dat = dumpsite + ".dat";
+  struct stat info;
+  if (stat(dat.c_str(), &info) || info.st_size < datLength || truncate(dat.c_str(), datLength))
+    throw std::runtime_error("Simulation::init(): " + dat + " does not match " + _resume);
+  report_dat.open(dat.c_str(), std::ios::app);
+}
+
+void BioSim::Simulation::startThreads() {
+  pool.resize(threads > 1 ? threads : 1);
+  workers.resize(pool.size());
+  reports.resize(report_threads > 0 ? report_threads : 0);
+}
+
+/** Threads do not survive fork(), so a Simulation that is to be forked after init() must first be suspended. The child goes on
+ *  with redirect() and run(); the parent may fork again, or be destroyed.
+ */
+void BioSim::Simulation::suspend() {
+  pool.resize(1);
+  reports.resize(0);
+}
 
+/** Must be called between init() and run(), and not when resuming from a checkpoint. The output directory is created if necessary.
+ *  @param stem The new filename base, replacing @c UtdataStamme.
+ */
+void BioSim::Simulation::redirect(const std::string &stem) {
+  dumpsite = stem;
   createOutputDir();
+  startThreads();
+}
+
+/** The fitness tables are rebuilt with @c FitnessToleranse, and the fitness of the Animals already inserted computed afresh.
+ *  @param name  The name of the Species.
+ *  @param param The keyword of the parameter in the .par file; see BioSim::Species::parameter().
+ *  @param value The new value.
+ */
+void BioSim::Simulation::adjustSpecies(const std::string &name, const std::string &param, double value) {
+  Species *target = genus(name);
+  if (!target) throw std::runtime_error("Simulation::adjustSpecies(): no species " + name);
+  if (!target->parameter(param, value))
+    throw std::runtime_error("Simulation::adjustSpecies(): " + name + " has no parameter " + param);
+  target->tabulate(fitness_tolerance);
+  animals.forgetFitness(animals.speciesId(target));
+}
 
-  openReport_dat();
+/** Every Cell of the type is stocked to a new @c fmax, as it was to the old one by init().
+ *  @param name  The name of the terrain type.
+ *  @param param @c alpha or @c fmax.
+ *  @param value The new value.
+ */
+void BioSim::Simulation::adjustTerrain(char name, const std::string &param, double value) {
+  ArchCell *target = geography.archetype(name);
+  if (!target) throw std::runtime_error("Simulation::adjustTerrain(): no terrain type " + std::string(1, name));
+  if (param == "alpha") {
+    target->alpha(value);
+  } else if (param == "fmax") {
+    target->maxfeed(value);
+    for (unsigned int i = 0; i < geography.size(); i++) {
+      if (geography.cell(i)->cellName() == name) geography.cell(i)->stock(value);
+    }
+  } else {
+    throw std::runtime_error("Simulation::adjustTerrain(): terrain types have no parameter " + param);
+  }
 }
 
 /** This function is analogous to main(); once basic setup is completed, it can be called, and it performs all the work that the simulation is ever expected to perform.
@@ -91,8 +177,11 @@ void BioSim::Simulation::init(const std::string &parameters) {
  *  @return The return value from this function should be propagated to the main() return value.
  */
 int BioSim::Simulation::run() {
-  _year = year_begin;
-  writeReport_dat();
+  if (_resume.empty()) {
+    _year = year_begin;
+    openReport_dat();
+    writeReport_dat();
+  }
   while (_year <= year_end) {
     step();
     _year++;
@@ -103,83 +192,90 @@ int BioSim::Simulation::run() {
     if (inter_png    && !(_year % inter_png))    writeReport_png();
 #endif
     writeReport_dat();
+    if (inter_chk    && !(_year % inter_chk)) {
+      reports.drain(); // A checkpoint implies that the reports before it are on disk.
+      if (!writeCheckpoint())
+        std::cerr << "Warning: could not write checkpoint for year " << _year << std::endl;
+    }
   }
+  reports.drain();
   std::cout << std::endl;
   closeReport_dat();
   return EXIT_SUCCESS;
 }
 
+/** Used to time whole years, as by the benchmarks; run() is the way to simulate. Must be called after init().
+ *  @return The number of Animals at the start of the year, each of which was stepped.
+ */
+unsigned int BioSim::Simulation::advance() {
+  unsigned int stepped = animals.size();
+  step();
+  _year++;
+  return stepped;
+}
+
 /** This function forms the heart and soul of the simulation; it is run once for each year of simulation, and handles all 6 seasons of Bjarnøya, as well as other housekeeping duties.
+ *
+ *  Each step is run tile by tile on the ThreadPool; see BioSim::Map::partition(). A tile only modifies its own Cells and their
+ *  inhabitants. Anything reaching beyond the tile, such as Animals wandering into another tile, newborns and deaths, is recorded
+ *  and applied afterwards on the calling thread, in tile order. Random numbers are drawn from streams addressed by the year, the
+ *  step and the Animal or Cell concerned; see BioSim::RandomPhase. The outcome therefore depends on neither the number of threads
+ *  nor on which thread runs which tile.
  */
 void BioSim::Simulation::step() {
+  rng.year(_year);
+  unsigned int tileCount = geography.tiles();
   // Step 1: Aging
   // Step 2: Weight loss
   // Step 4: Death
   /// @par Aging, weight loss and Death.
-  /// First all animals are gone through and aged. Any animals that die are at this point removed, and their memory freed.
-  std::set<Animal*>::iterator iter = animals.begin();
-  while (iter != animals.end()) {
-    (*iter)->age();
-    if ((*iter)->die()) {
-      delete (*iter);
-      animals.erase(iter++);
-    } else iter++;
-  }
+  /// All animals are aged, their fitness is recomputed in batches, and each decides whether it dies; the dead are removed and their slots freed.
+  pool.run(tileCount, [this](size_t tile, unsigned int thread) { ageTile(tile, workers[thread]); });
+  bury();
   // Step 3: Wandering
   // Step x: regrowth
   /// @par Wandering and regrowth.
-  /// All the cells of the map where animals might reside are gone through in random order, and in each cell all Animals attempts to wander.
-  /// At the same time, each cell is asked to regrow its graze.
-  std::vector<Cell*> cells = geography.mapMap();
-  std::vector<Cell*>::iterator it2;
-  for (it2 = cells.begin(); it2 != cells.end(); it2++) {
-    if (((*it2)->animals().size()))
-      (*it2)->wander();
-    (*it2)->regrow();
+  /// First every Animal decides whether and where to wander, without anything being moved, and each cell is asked to regrow its
+  /// graze. Then all wandering Animals leave their Cells, and finally they enter their new Cells, each tile taking in its own
+  /// arrivals. Every Animal thus wanders at most once a year, and the outcome does not depend on the order of the Cells.
+  pool.run(tileCount, [this](size_t tile, unsigned int thread) { wanderTile(tile, tiles[tile]); });
+  for (unsigned int tile = 0; tile < tileCount; tile++) tiles[tile].arrivals.clear();
+  for (unsigned int tile = 0; tile < tileCount; tile++) {
+    std::vector<Migrant> &migrants = tiles[tile].migrants;
+    for (size_t i = 0; i < migrants.size(); i++) {
+      tiles[geography.tileOf(migrants[i].cell)].arrivals.push_back(migrants[i]);
+    }
   }
+  pool.run(tileCount, [this](size_t tile, unsigned int thread) { departTile(tiles[tile]); });
+  pool.run(tileCount, [this](size_t tile, unsigned int thread) { arriveTile(tiles[tile]); });
   /// @par Breeding
-  /// Each cell is gone through again, this time all animals are asked to breed, and the resulting newborns are added to the menagerie.
+  /// Each cell is gone through again, this time all animals are asked to breed. The newborns of all Cells are given their
+  /// slots in the AnimalStore at once, in Cell index order, and are then added to the menagerie tile by tile.
   // Step 5: Breeding
-  std::list<Species>::iterator generaIterator = species.begin(); // By reloading this for each step, the method holds
-  std::vector<Species*> allSpecies;                              // even if the program is modified to allow afterloading
-  while (generaIterator != species.end()) {                      // of populations during execution.
-    allSpecies.push_back(&(*generaIterator));
-    generaIterator++;
+  pool.run(tileCount, [this](size_t tile, unsigned int thread) { breedTile(tile, tiles[tile]); });
+  unsigned int births = 0;
+  for (size_t index = 0; index < litters.size(); index++) {
+    firstborn[index] = births;
+    births += litters[index];
   }
-  for (it2 = cells.begin(); it2 != cells.end(); it2++) {
-    std::vector<Animal*> newBeasts = (*it2)->breed(allSpecies);
-    animals.insert(newBeasts.begin(),newBeasts.end());
+  newborns.resize(births);
+  if (births) {
+    animals.allocate(births, newborns.data());
+    pool.run(tileCount, [this](size_t tile, unsigned int thread) { bearTile(tile, tiles[tile]); });
   }
   /// @par Sustenance
-  /// Finally, all the animals are gone throught in order from most fit to least fit, herbivores first; and each animal eats its fill.
+  /// Finally, all the animals eat their fill; see BioSim::Simulation::feedCell().
   // Step 6: Sustenance
-  std::vector<Animal *>::iterator fbiter,fbound;
-  std::vector<Animal *> feedBeasts(animals.begin(),animals.end());
-  std::sort(feedBeasts.begin(),feedBeasts.end(),p_fit);
-  fbound = std::stable_partition(feedBeasts.begin(),feedBeasts.end(),part_pred);
-
+  pool.run(tileCount, [this](size_t tile, unsigned int thread) { feedTile(tile, workers[thread]); });
   int pred = 0;
   int prey = 0;
-
-  std::vector<Animal*> food;
-  fbiter = feedBeasts.begin();
-  while (fbiter != feedBeasts.end()) {
-    food = (*fbiter)->feed();
-    if (food.size() == 1 && food[0] == (*fbiter)) {
-      prey++;
-    } else {
-      pred++;
-      if (food.size()) {                                                    // This may be unsafe for multiple predatory species.
-        std::vector<Animal*>::iterator fooditer;                            // For a single predatory species, however, this is never problematic.
-        for (fooditer = food.begin(); fooditer != food.end(); fooditer++) { // The fix is simple enough, but it requires a few extra computer cycles;
-          prey--;                                                           // and it's not a likely need. It is therefore left as-is.
-          animals.erase(*fooditer);
-          delete *fooditer;
-        }
-      }
-    }
-    fbiter++;
+  for (size_t i = 0; i < workers.size(); i++) {
+    prey += workers[i].prey;
+    pred += workers[i].pred;
+    workers[i].prey = workers[i].pred = 0;
   }
+  bury();
+  tally();
 
   std::cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
   std::cout << "År:"
@@ -190,6 +286,217 @@ void BioSim::Simulation::step() {
             << std::flush;
 }
 
+/** Animals that die are removed from their Cells and recorded in @c buffers.dead; see BioSim::Simulation::bury().
+ *  @param tile    The tile.
+ *  @param buffers The scratch space of the calling thread.
+ */
+void BioSim::Simulation::ageTile(unsigned int tile, StepBuffers &buffers) {
+  CellRange cells = geography.tile(tile);
+  for (size_t c = 0; c < cells.size(); c++) {
+    Cell *loci = cells[c];
+    if (!loci->headcount()) continue;
+    loci->matureAll(); // Everybody is at least 1 year old after aging.
+    for (unsigned short genus = 0; genus < loci->genera(); genus++) {
+      Span<const AnimalHandle> beasts = loci->inhabitants(genus).handles();
+      size_t n = beasts.size();
+      if (!n) continue;
+      /// Each Bucket is handled in three sweeps: aging and weight loss, fitness in a batch, and death, with one random number
+      /// per Animal drawn in bulk and handed to Species::die(). Cell::cull() then removes the dead in one pass.
+      Species *isa = allSpecies[genus];
+      for (size_t i = 0; i < n; i++) {
+        AnimalHandle beast = beasts[i];
+        double &vekt = animals.vekt(beast);
+        animals.alder(beast)++;
+        vekt = vekt - isa->weightloss(vekt);
+        animals.fitness(beast) = ANIMAL_INV;
+      }
+      animals.refreshFitness(genus, beasts.begin(), n, buffers.batch);
+      if (buffers.uniform.size() < n) buffers.uniform.resize(n);
+      if (buffers.doomed.size() < n) buffers.doomed.resize(n);
+      rng.drand(PHASE_DEATH, beasts.begin(), n, 0, buffers.uniform.data());
+      unsigned int deaths = 0;
+      for (size_t i = 0; i < n; i++) {
+        bool death = animals.vekt(beasts[i]) == 0 || isa->die(animals.fitness(beasts[i]), buffers.uniform[i]);
+        buffers.doomed[i] = death;
+        deaths += death;
+      }
+      if (deaths) buffers.census[censusOf(genus, loci)] -= loci->cull(genus, buffers.doomed.data(), buffers.dead);
+    }
+  }
+}
+
+/** Nothing is moved; every Animal that wanders is recorded in @c outbox.migrants with its destination. Only the graze of the
+ *  Cells is modified.
+ *  @param tile   The tile.
+ *  @param outbox The cross-tile effects of the tile. Its migrants are cleared first.
+ */
+void BioSim::Simulation::wanderTile(unsigned int tile, TileBuffers &outbox) {
+  outbox.migrants.clear();
+  CellRange cells = geography.tile(tile);
+  for (size_t c = 0; c < cells.size(); c++) {
+    Cell *loci = cells[c];
+    loci->regrow();
+    if (!loci->headcount()) continue;
+    toolbox::RandomStream steps = rng.stream(PHASE_WANDER, loci->index());
+    for (unsigned short genus = 0; genus < loci->genera(); genus++) {
+      AnimalRange beasts = loci->inhabitants(genus);
+      for (size_t i = 0; i < beasts.size(); i++) {
+        Animal beast = beasts[i];
+        if (!beast.genus()->willWander(beast.fitness(), steps)) continue;
+        Cell *destination = loci->neighbour(steps.nrand(4));
+        if (!destination || !destination->addAnimal()) continue;
+        Migrant migrant = {beast.handle(), destination->index()};
+        outbox.migrants.push_back(migrant);
+      }
+    }
+  }
+}
+
+/** The Animals are left outside any Cell until arriveTile(). Only the Cells of the tile are modified.
+ *  @param outbox The cross-tile effects of the tile.
+ */
+void BioSim::Simulation::departTile(TileBuffers &outbox) {
+  std::vector<Migrant> &migrants = outbox.migrants;
+  for (size_t i = 0; i < migrants.size(); i++) {
+    Animal beast(&animals, migrants[i].beast);
+    outbox.census[censusOf(animals.genus(migrants[i].beast), beast.location())]--;
+    beast.location()->removeAnimal(beast);
+    animals.loci(migrants[i].beast) = CELL_NONE;
+  }
+}
+
+/** Arrivals are sorted by Cell, and within a Cell by handle, so that the order of the inhabitants of a Cell does not depend on
+ *  where its newcomers came from. Only the Cells of the tile are modified.
+ *  @param inbox The cross-tile effects of the tile.
+ */
+void BioSim::Simulation::arriveTile(TileBuffers &inbox) {
+  std::vector<Migrant> &arrivals = inbox.arrivals;
+  std::sort(arrivals.begin(), arrivals.end(), [](const Migrant &a, const Migrant &b) {
+    return a.cell < b.cell || (a.cell == b.cell && a.beast < b.beast);
+  });
+  for (size_t i = 0; i < arrivals.size(); i++) {
+    Cell *destination = geography.cell(arrivals[i].cell);
+    inbox.census[censusOf(animals.genus(arrivals[i].beast), destination)]++;
+    Animal(&animals, arrivals[i].beast).moveTo(destination);
+  }
+}
+
+/** The parents lose their birth weight at once; the newborns are recorded in @c outbox.births, and counted in @c litters, to be
+ *  created by step().
+ *  @param tile   The tile.
+ *  @param outbox The cross-tile effects of the tile. Cleared first.
+ */
+void BioSim::Simulation::breedTile(unsigned int tile, TileBuffers &outbox) {
+  outbox.births.clear();
+  CellRange cells = geography.tile(tile);
+  for (size_t c = 0; c < cells.size(); c++) {
+    Cell *loci = cells[c];
+    outbox.litter.clear();
+    if (loci->headcount()) {
+      toolbox::RandomStream births = rng.stream(PHASE_BREED, loci->index());
+      loci->breed(allSpecies, births, outbox.litter);
+    }
+    litters[loci->index()] = outbox.litter.size();
+    for (size_t i = 0; i < outbox.litter.size(); i++) {
+      Birth birth = {loci->index(), outbox.litter[i]};
+      outbox.births.push_back(birth);
+    }
+  }
+}
+
+/** The newborns are created in the slots reserved for their Cells in @c newborns, and placed in the Cells of their parents.
+ *  Handing out the slots by Cell index rather than by tile keeps the handles, and so the random streams of the Animals,
+ *  independent of the tiling.
+ *  @param tile   The tile.
+ *  @param outbox The cross-tile effects of the tile.
+ */
+void BioSim::Simulation::bearTile(unsigned int tile, TileBuffers &outbox) {
+  for (size_t i = 0; i < outbox.births.size(); i++) {
+    const Birth &birth = outbox.births[i];
+    AnimalHandle slot = newborns[firstborn[birth.cell]++];
+    animals.emplace(slot, birth.genus, 0, allSpecies[birth.genus]->birthweight());
+    Cell *nest = geography.cell(birth.cell);
+    outbox.census[censusOf(birth.genus, nest)]++;
+    Animal(&animals, slot).moveTo(nest);
+  }
+}
+
+/** @param tile    The tile.
+ *  @param buffers The scratch space of the calling thread.
+ */
+void BioSim::Simulation::feedTile(unsigned int tile, StepBuffers &buffers) {
+  CellRange cells = geography.tile(tile);
+  for (size_t c = 0; c < cells.size(); c++) {
+    if (!cells[c]->headcount()) continue;
+    refreshCell(cells[c], buffers); // Parents and newborns, ahead of sorting.
+    feedCell(cells[c], buffers);
+  }
+}
+
+/** @param loci    The Cell.
+ *  @param buffers The scratch space of the calling thread.
+ */
+void BioSim::Simulation::refreshCell(Cell *loci, StepBuffers &buffers) {
+  for (unsigned short genus = 0; genus < loci->genera(); genus++) {
+    Span<const AnimalHandle> beasts = loci->inhabitants(genus).handles();
+    animals.refreshFitness(genus, beasts.begin(), beasts.size(), buffers.batch);
+  }
+}
+
+/** Also sizes the census changes of every thread and tile, and picks the .dat columns: the classic terrain types J, S and O
+ *  always, for compatibility, followed by any other live terrain type in order of name.
+ */
+void BioSim::Simulation::recount() {
+  unsigned int terrains = geography.terrains();
+  census.assign((size_t) allSpecies.size() * terrains, 0);
+  for (size_t i = 0; i < workers.size(); i++) workers[i].census.assign(census.size(), 0);
+  for (size_t i = 0; i < tiles.size(); i++) tiles[i].census.assign(census.size(), 0);
+  AnimalHandle slots = animals.slots();
+  for (AnimalHandle beast = 0; beast < slots; beast++) {
+    if (!animals.valid(beast)) continue;
+    census[censusOf(animals.genus(beast), geography.cell(animals.loci(beast)))]++;
+  }
+
+  const std::string classics = "JSO";
+  columnNames = classics;
+  columns.assign(classics.size(), -1);
+  for (unsigned int t = 0; t < terrains; t++) {
+    size_t classic = classics.find(geography.terrain(t)->name());
+    if (classic != std::string::npos) {
+      columns[classic] = t;
+    } else if (geography.terrain(t)->live()) {
+      columns.push_back(t);
+      columnNames += geography.terrain(t)->name();
+    }
+  }
+}
+
+/** The changes are added in thread and tile order; being sums of integers, the result is the same in any order. */
+void BioSim::Simulation::tally() {
+  for (size_t i = 0; i < workers.size(); i++) {
+    std::vector<int> &delta = workers[i].census;
+    for (size_t k = 0; k < delta.size(); k++) census[k] += delta[k];
+    std::fill(delta.begin(), delta.end(), 0);
+  }
+  for (size_t i = 0; i < tiles.size(); i++) {
+    std::vector<int> &delta = tiles[i].census;
+    for (size_t k = 0; k < delta.size(); k++) census[k] += delta[k];
+    std::fill(delta.begin(), delta.end(), 0);
+  }
+}
+
+/// Freeing slots in handle order keeps the free list, and so the handles of later newborns, independent of the number of threads.
+void BioSim::Simulation::bury() {
+  std::vector<AnimalHandle> &dead = workers[0].dead;
+  for (size_t i = 1; i < workers.size(); i++) {
+    dead.insert(dead.end(), workers[i].dead.begin(), workers[i].dead.end());
+    workers[i].dead.clear();
+  }
+  std::sort(dead.begin(), dead.end());
+  for (size_t i = 0; i < dead.size(); i++) animals.destroy(dead[i]);
+  dead.clear();
+}
+
 /** @param archs Filename for cells.par file.
  *  @param geo_param Filename for .geo file.
  */
@@ -197,6 +504,7 @@ void BioSim::Simulation::initGeo(const std::string &archs,const std::string &geo
   _year = 0;
   geography.initArch(archs);
   geography.init(geo_param);
+  geography.population(&animals);
 }
 
 /** @param spec Filename for cells.spec file.
@@ -206,6 +514,7 @@ void BioSim::Simulation::initGeoSpec(const std::string &spec, const std::string
   _year = 0;
   geography.initSpec(spec);
   geography.init(geo_param);
+  geography.population(&animals);
 }
 
 /** @param species_par A filename containg a species.par file.
@@ -215,33 +524,40 @@ BioSim::Species * BioSim::Simulation::initSpecies(const std::string &species_par
   BioSim::Species newGenus;
   newGenus.init(species_par);
   species.push_back(newGenus);
-  return &species.back();
+  BioSim::Species *genus = &species.back();
+  double error = genus->tabulate(fitness_tolerance);
+  if (fitness_check) {
+    error = std::max(error, genus->deviation());
+    std::cout << "Fitness " << genus->genus() << ": " << genus->weightPoints() << " vektpunkter, største avvik " << error << std::endl;
+  }
+  animals.addSpecies(genus);
+  return genus;
 }
 
 /** @param archetype Species of the new Animal.
  *  @param x X location of the new Animal.
  *  @param y Y location of the new Animal.
- *  @return A pointer to a newly created Animal instance.
+ *  @return The newly created Animal, or a zombie Animal if x, y is not a live Cell.
  */
-BioSim::Animal *BioSim::Simulation::vivify(Species *archetype,unsigned int x, unsigned int y) {
+BioSim::Animal BioSim::Simulation::vivify(Species *archetype,unsigned int x, unsigned int y) {
   BioSim::Cell * locus = geography.at(x,y);
-  if (!locus || !(locus->addAnimal())) return NULL;
-  Animal * newBeast = new Animal(archetype, locus);
-  animals.insert(newBeast);
+  if (!locus || !(locus->addAnimal())) return Animal();
+  Animal newBeast(&animals, animals.create(animals.speciesId(archetype), 0, archetype->birthweight()));
+  newBeast.moveTo(locus);
   return newBeast;
 }
 
 /** @param name Name of the Species of the new Animal.
  *  @param x X location of the new Animal.
  *  @param y Y location of the new Animal.
- *  @return A pointer to a newly created Animal instance.
+ *  @return The newly created Animal, or a zombie Animal if there is no such Species.
  */
-BioSim::Animal *BioSim::Simulation::vivify(const std::string &name,unsigned int x, unsigned int y) {
+BioSim::Animal BioSim::Simulation::vivify(const std::string &name,unsigned int x, unsigned int y) {
   std::list<Species>::iterator iter;
   for (iter = species.begin(); iter != species.end(); iter++) {
     if (iter->genus() == name) return this->vivify(&(*iter),x,y);
   }
-  return NULL;
+  return Animal();
 }
 
 /** @param archetype Species of the new Animal.
@@ -249,13 +565,13 @@ BioSim::Animal *BioSim::Simulation::vivify(const std::string &name,unsigned int
  *  @param weight The weight of the new Animal.
  *  @param x X location of the new Animal.
  *  @param y Y location of the new Animal.
- *  @return A pointer to a newly created Animal instance.
+ *  @return The newly created Animal, or a zombie Animal on failure.
  */
-BioSim::Animal *BioSim::Simulation::insertAnimal(Species *archetype, int age, double weight, unsigned int x, unsigned int y) {
-  if (!archetype) return NULL;
-  BioSim::Animal *newBeast = vivify(archetype, x, y);
-  if (!newBeast) return NULL;
-  newBeast->adjust(age,weight);
+BioSim::Animal BioSim::Simulation::insertAnimal(Species *archetype, int age, double weight, unsigned int x, unsigned int y) {
+  if (!archetype) return Animal();
+  BioSim::Animal newBeast = vivify(archetype, x, y);
+  if (!newBeast.valid()) return newBeast;
+  newBeast.adjust(age,weight);
   return newBeast;
 }
 
@@ -264,57 +580,100 @@ BioSim::Animal *BioSim::Simulation::insertAnimal(Species *archetype, int age, do
  *  @param weight The weight of the new Animal.
  *  @param x X location of the new Animal.
  *  @param y Y location of the new Animal.
- *  @return A pointer to a newly created Animal instance.
+ *  @return The newly created Animal, or a zombie Animal on failure.
  */
-BioSim::Animal *BioSim::Simulation::insertAnimal(const std::string &name, int age, double weight, unsigned int x, unsigned int y) {
+BioSim::Animal BioSim::Simulation::insertAnimal(const std::string &name, int age, double weight, unsigned int x, unsigned int y) {
   return insertAnimal(genus(name),age,weight,x,y);
 }
 
 /** Any number of .pop files may be read with this function. The resulting population is the sum of all read files.
- *  @param population A filename containing a .pop file.
+ *  A .bpop file, recognized by its contents rather than by its name, is mapped into memory and inserted in bulk.
+ *  @param population A filename containing a .pop or .bpop file.
  *  @return True if the read was successful.
  */
 bool BioSim::Simulation::readPopulation(const std::string &population) {
-  std::ifstream popstream(population.c_str());
-  if (!popstream)
-    throw std::runtime_error("Simulation::readPopulation(): Could not open " + population);
-  std::string geography;
-  while (popstream) {
-    toolbox::skip_comment(popstream, COMMENT_CHAR);
-    std::string param;
-    std::string value;
-    popstream >> param;
-    popstream >> value;
-    if (param == "Geografi") {
-      geography = value;
-      break;
+  return readPopulations(std::list<std::string>(1, population));
+}
+
+/** The files are read concurrently on the pool, and large text files are split at Cell block boundaries and their chunks
+ *  parsed concurrently as well. The Animals are then inserted in the order of the files and of the blocks within them, so
+ *  the result is the same as reading the files one by one, whatever the number of threads.
+ *  @param populations Filenames of .pop or .bpop files.
+ *  @return True if the read was successful.
+ */
+bool BioSim::Simulation::readPopulations(const std::list<std::string> &populations) {
+  std::vector<std::string> paths(populations.begin(), populations.end());
+  std::vector<std::unique_ptr<PopulationText> > texts(paths.size());
+  pool.run(paths.size(), [&](size_t i, unsigned int thread) {
+    if (PopulationMap::recognize(paths[i])) return;
+    texts[i].reset(new PopulationText(paths[i]));
+    texts[i]->split(std::min<size_t>(pool.size() * 4, texts[i]->size() / POPULATION_CHUNK + 1));
+  });
+
+  std::vector<std::pair<size_t, size_t> > chunks; // (file, chunk)
+  for (size_t i = 0; i < texts.size(); i++) {
+    if (texts[i]) for (size_t c = 0; c < texts[i]->chunks(); c++) chunks.push_back(std::make_pair(i, c));
+  }
+  std::vector<Population> parts(chunks.size());
+  pool.run(chunks.size(), [&](size_t task, unsigned int thread) {
+    texts[chunks[task].first]->parse(chunks[task].second, parts[task]);
+  });
+
+  size_t part = 0;
+  for (size_t i = 0; i < paths.size(); i++) {
+    if (!texts[i]) {
+      PopulationMap file(paths[i]);
+      std::vector<std::string> names;
+      for (unsigned int g = 0; g < file.genera(); g++) names.push_back(file.genus(g));
+      insertPopulation(names, file.blocks(), file.blockCount(), file.records());
+      continue;
     }
-    if (popstream.eof())
-      break;
-    else if ( popstream.fail() )
-      throw std::runtime_error("Simulation::readPopulation(): read error");
-  }
-  while (popstream.good()) {
-    toolbox::skip_comment(popstream, COMMENT_CHAR);
-    std::string type;
-    unsigned int x;
-    unsigned int y;
-    unsigned int headcount;
-    popstream >> type >> x >> y >> headcount;
-    if (type != "") {
-      for (unsigned int i = 0; i != headcount; i++) {
-        toolbox::skip_comment(popstream,COMMENT_CHAR);
-        int age;
-        double weight;
-        popstream >> age >> weight;
-        insertAnimal(type,age,weight,x,y);
-      }
+    for (size_t c = 0; c < texts[i]->chunks(); c++, part++) {
+      const Population &chunk = parts[part];
+      insertPopulation(chunk.genera, chunk.blocks.data(), chunk.blocks.size(), chunk.records.data());
     }
   }
-
   return true;
 }
 
+/** Species names are looked up once per species rather than once per Animal, and all slots are taken from the AnimalStore
+ *  at once. The result is the same as calling insertAnimal() for each Animal in turn: Animals of unknown Species, or outside
+ *  the live Cells, are skipped, and the rest get the same handles and places in their Cells.
+ *  @param names   The names of the Species, indexed by PopulationBlock::genus.
+ *  @param blocks  The Cell blocks.
+ *  @param count   The number of Cell blocks.
+ *  @param records The Animal records the blocks refer to.
+ *  @return The number of Animals inserted.
+ */
+size_t BioSim::Simulation::insertPopulation(const std::vector<std::string> &names, const PopulationBlock *blocks, size_t count, const PopulationRecord *records) {
+  std::vector<unsigned short> ids(names.size(), SPECIES_NONE);
+  for (size_t i = 0; i < names.size(); i++) {
+    Species *archetype = genus(names[i]);
+    if (archetype) ids[i] = animals.speciesId(archetype);
+  }
+  std::vector<Cell*> homes(count, (Cell *) NULL);
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    Cell *locus = geography.at(blocks[i].x, blocks[i].y);
+    if (ids[blocks[i].genus] == SPECIES_NONE || !locus || !locus->addAnimal()) continue;
+    homes[i] = locus;
+    total += blocks[i].count;
+  }
+  if (!total) return 0;
+  std::vector<AnimalHandle> slots(total);
+  animals.allocate(total, slots.data());
+  size_t next = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (!homes[i]) continue;
+    const PopulationRecord *record = records + blocks[i].first;
+    for (uint32_t j = 0; j < blocks[i].count; j++, next++) {
+      animals.emplace(slots[next], ids[blocks[i].genus], record[j].alder, record[j].vekt);
+      Animal(&animals, slots[next]).moveTo(homes[i]);
+    }
+  }
+  return total;
+}
+
 /** @param typeName The name of a Species of Animal.
  *  @return The Species with name typeName.
  */
@@ -348,10 +707,183 @@ bool BioSim::Simulation::createOutputDir() {
 bool BioSim::Simulation::openReport_dat() {
   report_dat.open((dumpsite + ".dat").c_str());
   report_dat << COMMENT_CHAR << std::endl << "Geografi     " <<  _geography << std::endl;
-  report_dat << COMMENT_CHAR <<"Year     B/J     R/J     B/S     R/S     B/O     R/O" << std::endl;
+  report_dat << COMMENT_CHAR << "Year";
+  for (size_t c = 0; c < columnNames.size(); c++) {
+    report_dat << std::setw(8) << "B/" + columnNames.substr(c, 1) << std::setw(8) << "R/" + columnNames.substr(c, 1);
+  }
+  report_dat << std::endl;
   return report_dat.good();
 }
 
+/** Within a Cell the herbivores feed first, then the predators, each group from the most to the least fit. Predation draws from
+ *  the Cell's own random stream. With @c SortertJakt, predators use BioSim::Species::hunt() instead of BioSim::Species::feed().
+ *  Eaten Animals are marked with BioSim::Animal::kill() and left in the Cell while the Cell feeds, so that later predators only
+ *  skip them. Once all have fed they are removed with one BioSim::Cell::cull() per species and recorded in @c buffers.dead for
+ *  BioSim::Simulation::bury() to destroy. Only the Cell itself and its inhabitants are modified.
+ *  @param loci    The Cell to feed.
+ *  @param buffers The scratch space of the calling thread.
+ */
+void BioSim::Simulation::feedCell(Cell *loci, StepBuffers &buffers) {
+  if (!loci->headcount()) return;
+  loci->random() = rng.stream(PHASE_FEED, loci->index());
+  std::vector<Animal> &order = buffers.order;
+  order.clear();
+  for (int predatory = 0; predatory < 2; predatory++) {
+    size_t first = order.size();
+    for (unsigned short genus = 0; genus < loci->genera(); genus++) {
+      if (animals.species(genus)->predator() != (bool)predatory) continue;
+      AnimalRange group = loci->inhabitants(genus);
+      order.insert(order.end(), group.begin(), group.end());
+    }
+    std::sort(order.begin() + first, order.end(), p_fit);
+  }
+  size_t herbivores = 0;
+  while (herbivores < order.size() && !order[herbivores].genus()->predator()) herbivores++;
+
+  std::vector<Animal> &food = buffers.food;
+  std::vector<Animal> &prey = buffers.hunted;
+  size_t weakest = 0;
+  std::vector<Animal>::iterator iter;
+  size_t eaten = 0;
+  for (iter = order.begin(); iter != order.end(); iter++) {
+    if (iter->dead()) continue; // Eaten earlier this year by a predator of another species.
+    if (sorted_hunt && iter->genus()->predator()) {
+      if (iter == order.begin() + herbivores) {
+        // The herbivores have fed, so their fitness is final for the year.
+        prey.assign(order.begin(), order.begin() + herbivores);
+        std::sort(prey.begin(), prey.end(), p_unfit);
+      }
+      iter->genus()->hunt(*iter, prey, weakest, food);
+    } else {
+      iter->feed(food);
+    }
+    if (food.size() == 1 && food[0] == (*iter)) {
+      buffers.prey++;
+    } else {
+      buffers.pred++;
+      buffers.prey -= food.size();
+      eaten += food.size();
+    }
+  }
+  if (!eaten) return;
+
+  for (unsigned short genus = 0; genus < loci->genera(); genus++) {
+    Span<const AnimalHandle> beasts = loci->inhabitants(genus).handles();
+    if (buffers.doomed.size() < beasts.size()) buffers.doomed.resize(beasts.size());
+    unsigned int tombstones = 0;
+    for (size_t i = 0; i < beasts.size(); i++) {
+      buffers.doomed[i] = animals.vekt(beasts[i]) == 0;
+      tombstones += buffers.doomed[i];
+    }
+    if (tombstones) buffers.census[censusOf(genus, loci)] -= loci->cull(genus, buffers.doomed.data(), buffers.dead);
+  }
+}
+
+/** A checkpoint holds everything that changes as the Simulation runs: the year, the random generator, the Species parameters,
+ *  the feed of every Cell, every slot of the AnimalStore, and the length of the .dat report. The order of the inhabitants of
+ *  each Cell is implied by the AnimalStore. A Simulation resumed from it continues exactly as the original would have.
+ *
+ *  The file, @c UtdataStamme.NNNNN.chk, is written to a temporary name and renamed into place, so that a crash never leaves a
+ *  partial checkpoint. With @c KomprimerChk it is gzip compressed; otherwise it is written uncompressed through the same
+ *  interface, and readCheckpoint() takes either.
+ *  @return True if the checkpoint was written.
+ */
+bool BioSim::Simulation::writeCheckpoint() {
+  report_dat.flush(); // The recorded length must be on disk before the checkpoint is.
+  std::ostringstream os(std::ios::binary);
+  uint32_t version = CHECKPOINT_VERSION;
+  int32_t year = _year;
+  int64_t datLength = report_dat.tellp();
+  os.write(CHECKPOINT_MAGIC, 8);
+  os.write((const char *) &version, sizeof(version));
+  os.write((const char *) &year, sizeof(year));
+  os.write((const char *) &datLength, sizeof(datLength));
+  rng.write(os);
+  uint16_t genera = allSpecies.size();
+  os.write((const char *) &genera, sizeof(genera));
+  for (size_t i = 0; i < allSpecies.size(); i++) allSpecies[i]->write(os);
+  uint32_t cellCount = geography.size();
+  os.write((const char *) &cellCount, sizeof(cellCount));
+  for (uint32_t i = 0; i < cellCount; i++) {
+    double feed = geography.cell(i)->graze();
+    os.write((const char *) &feed, sizeof(feed));
+  }
+  animals.write(os);
+  if (!os) return false;
+
+  toolbox::Filename fn(dumpsite);
+  std::string path = fn.num_name(_year) + ".chk";
+  std::string temp = path + ".tmp";
+  gzFile out = gzopen(temp.c_str(), compress_chk ? "wb6" : "wbT");
+  if (!out) return false;
+  const std::string &data = os.str();
+  size_t done = 0;
+  while (done < data.size()) {
+    unsigned int chunk = std::min(data.size() - done, (size_t) 1 << 30);
+    if (gzwrite(out, data.data() + done, chunk) != (int) chunk) break;
+    done += chunk;
+  }
+  if (gzclose(out) != Z_OK || done != data.size() || rename(temp.c_str(), path.c_str())) {
+    remove(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+/** Must be called after the Simulation has been set up from the same .sim file as the one that wrote the checkpoint; the
+ *  Map and the Species must match.
+ *  @param checkpoint The pathname of a checkpoint written by writeCheckpoint().
+ *  @param datLength  Set to the length the .dat report had when the checkpoint was written.
+ */
+void BioSim::Simulation::readCheckpoint(const std::string &checkpoint, long long &datLength) {
+  gzFile in = gzopen(checkpoint.c_str(), "rb");
+  if (!in) throw std::runtime_error("Simulation::readCheckpoint(): Could not open " + checkpoint);
+  std::string data;
+  char block[1 << 16];
+  int got;
+  while ((got = gzread(in, block, sizeof(block))) > 0) data.append(block, got);
+  gzclose(in);
+  if (got < 0) throw std::runtime_error("Simulation::readCheckpoint(): Could not read " + checkpoint);
+
+  std::istringstream is(data, std::ios::binary);
+  char magic[8];
+  uint32_t version = 0;
+  int32_t year = 0;
+  int64_t length = 0;
+  is.read(magic, 8);
+  is.read((char *) &version, sizeof(version));
+  if (!is || std::string(magic, 8) != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION)
+    throw std::runtime_error("Simulation::readCheckpoint(): " + checkpoint + " is not a BioSim checkpoint.");
+  is.read((char *) &year, sizeof(year));
+  is.read((char *) &length, sizeof(length));
+  rng.read(is);
+  uint16_t genera = 0;
+  is.read((char *) &genera, sizeof(genera));
+  if (!is || genera != allSpecies.size())
+    throw std::runtime_error("Simulation::readCheckpoint(): " + checkpoint + " has other species than the .sim file.");
+  for (size_t i = 0; i < allSpecies.size(); i++) {
+    std::string genus = allSpecies[i]->genus();
+    allSpecies[i]->read(is);
+    if (allSpecies[i]->genus() != genus)
+      throw std::runtime_error("Simulation::readCheckpoint(): " + checkpoint + " has other species than the .sim file.");
+    allSpecies[i]->tabulate(fitness_tolerance);
+  }
+  uint32_t cellCount = 0;
+  is.read((char *) &cellCount, sizeof(cellCount));
+  if (!is || cellCount != geography.size())
+    throw std::runtime_error("Simulation::readCheckpoint(): " + checkpoint + " has another map than the .sim file.");
+  for (uint32_t i = 0; i < cellCount; i++) {
+    double feed;
+    is.read((char *) &feed, sizeof(feed));
+    geography.cell(i)->stock(feed);
+  }
+  animals.read(is);
+  geography.resettle(&animals);
+  recount();
+  _year = year;
+  datLength = length;
+}
+
 /// @return True if the report.dat stream is still good.
 bool BioSim::Simulation::writeReport_dat() {
   return reportPopulation(report_dat).good();
@@ -361,138 +893,146 @@ void BioSim::Simulation::closeReport_dat() {
   report_dat.close();
 }
 
-/// @return True if the report was successfully written.
+/** The headcounts of the Cells are copied, and the report is written by the ReportWriter.
+ *  @return True if the report was handed over.
+ */
 bool BioSim::Simulation::writeReport_dyr () {
-  std::vector<Cell*> cellMap = geography.mapMap(true);
-  int x;
-  int y;
-  std::vector<Cell*>::iterator iter = cellMap.begin();
-  toolbox::Filename fn(dumpsite);
-  std::ofstream report_dyr((fn.num_name(_year) + ".dyr").c_str());
-  if (!report_dyr.good()) return false;
-  report_dyr << COMMENT_CHAR << std::endl << "Geografi     " <<  _geography << std::endl;
-  report_dyr << COMMENT_CHAR <<"  Bytte  Rovdyr" << std::endl;
-  y = 0;
-  x = cellMap.back()->x_pos(); ++x;
-  std::vector<BioSim::Animal*>::iterator it2;
-  while (iter != cellMap.end()) {
+  CellRange cellMap = geography.mapView(true);
+  std::shared_ptr<std::vector<std::pair<int, int> > > counts(new std::vector<std::pair<int, int> >());
+  counts->reserve(cellMap.size());
+  unsigned short genera = animals.speciesCount();
+  for (CellRange::iterator iter = cellMap.begin(); iter != cellMap.end(); iter++) {
     int rovdyr = 0;
     int bytte = 0;
-    std::vector<BioSim::Animal*> beasts = ((*iter)->animals());
-    it2 = beasts.begin();
-    while (it2 != beasts.end()) {
-      (*it2)->genus()->predator()?rovdyr++:bytte++;
-      it2++;
+    for (unsigned short genus = 0; genus < genera; genus++) {
+      if (animals.species(genus)->predator())
+        rovdyr += (*iter)->headcount(genus);
+      else
+        bytte += (*iter)->headcount(genus);
     }
-    report_dyr << std::setw(8) << bytte << std::setw(8) << rovdyr << std::endl;
-    iter++;
-    if (!(++y % x)) report_dyr << std::endl;
-    if (!report_dyr.good()) return false;
+    counts->push_back(std::make_pair(bytte, rovdyr));
   }
-
-  report_dyr << COMMENT_CHAR << " antall celler: " << y << std::endl;
-  report_dyr.close();
+  int x = cellMap[cellMap.size() - 1]->x_pos() + 1;
+  std::string name = toolbox::Filename(dumpsite).num_name(_year) + ".dyr";
+  std::string geo = _geography;
+  reports.submit(name, [counts, x, name, geo]() {
+    std::ofstream report_dyr(name.c_str());
+    if (!report_dyr.good()) return false;
+    report_dyr << COMMENT_CHAR << std::endl << "Geografi     " <<  geo << std::endl;
+    report_dyr << COMMENT_CHAR <<"  Bytte  Rovdyr" << std::endl;
+    int y = 0;
+    for (size_t i = 0; i < counts->size(); i++) {
+      report_dyr << std::setw(8) << (*counts)[i].first << std::setw(8) << (*counts)[i].second << std::endl;
+      if (!(++y % x)) report_dyr << std::endl;
+      if (!report_dyr.good()) return false;
+    }
+    report_dyr << COMMENT_CHAR << " antall celler: " << y << std::endl;
+    report_dyr.close();
+    return !report_dyr.fail();
+  });
   return true;
 }
 
-/// @return True if the report was successfully written.
+/** The feed of the Cells is copied, and the report is written by the ReportWriter.
+ *  @return True if the report was handed over.
+ */
 bool BioSim::Simulation::writeReport_for () {
-  std::vector<Cell*> cellMap = geography.mapMap(true);
-  unsigned int x;
-  unsigned int y;
-  std::vector<Cell*>::iterator iter = cellMap.begin();
-  toolbox::Filename fn(dumpsite);
-  std::ofstream report_for((fn.num_name(_year) + ".for").c_str());
-  if (!report_for.good()) return false;
-  report_for << COMMENT_CHAR << std::endl << "Geografi     " <<  _geography << std::endl;
-  report_for << COMMENT_CHAR << " Fôr" << std::endl;
-  y = 0;
-  x = cellMap.back()->x_pos(); ++x;
-  while (iter != cellMap.end()) {
-    report_for << std::setw(5) << (*iter)->graze() << std::endl;
-    iter++;
-    if (!(++y % x)) report_for << std::endl;
+  CellRange cellMap = geography.mapView(true);
+  std::shared_ptr<std::vector<double> > feed(new std::vector<double>());
+  feed->reserve(cellMap.size());
+  for (CellRange::iterator iter = cellMap.begin(); iter != cellMap.end(); iter++) feed->push_back((*iter)->graze());
+  unsigned int x = cellMap[cellMap.size() - 1]->x_pos() + 1;
+  std::string name = toolbox::Filename(dumpsite).num_name(_year) + ".for";
+  std::string geo = _geography;
+  reports.submit(name, [feed, x, name, geo]() {
+    std::ofstream report_for(name.c_str());
     if (!report_for.good()) return false;
-  }
-
-  report_for << COMMENT_CHAR << " antall celler: " << y << std::endl;
-  report_for.close();
+    report_for << COMMENT_CHAR << std::endl << "Geografi     " <<  geo << std::endl;
+    report_for << COMMENT_CHAR << " Fôr" << std::endl;
+    unsigned int y = 0;
+    for (size_t i = 0; i < feed->size(); i++) {
+      report_for << std::setw(5) << (*feed)[i] << std::endl;
+      if (!(++y % x)) report_for << std::endl;
+      if (!report_for.good()) return false;
+    }
+    report_for << COMMENT_CHAR << " antall celler: " << y << std::endl;
+    report_for.close();
+    return !report_for.fail();
+  });
   return true;
 }
 
 #ifdef BIOSIM_PNG
-/// @return True if the image was successfully written.
+/** The changing rows of the map image are copied, and the image is compressed and written by the ReportWriter.
+ *  @return True if the report was handed over.
+ */
 bool BioSim::Simulation::writeReport_png() {
-  toolbox::Filename fn(dumpsite);
-  return geography.writeReport_png((fn.num_name(_year) + ".png"));
+  std::shared_ptr<std::vector<png_byte> > snapshot(new std::vector<png_byte>(geography.snapshotImage()));
+  std::string name = toolbox::Filename(dumpsite).num_name(_year) + ".png";
+  const Map *map = &geography;
+  PngProfile profile = png_profile;
+  unsigned int threads = png_threads > 1 ? png_threads : 1;
+  reports.submit(name, [snapshot, name, map, profile, threads]() { return map->writeImage(name, *snapshot, profile, threads); });
+  return true;
 }
 #endif
 
-/** @param unified Currently does nothing.
- *  @return True if the report was successfully written.
+/** The ages and weights of all Animals are copied into a Population, in the order of the report, and the report is written by
+ *  the ReportWriter.
+ *  @param unified Currently does nothing.
+ *  @return True if the report was handed over.
  */
 bool BioSim::Simulation::writeReport_pop(bool unified) {
-  std::vector<Cell*> cellMap = geography.mapMap(true);
-  std::vector<Cell*>::iterator iter = cellMap.begin();
-  toolbox::Filename fn(dumpsite);
-  std::ofstream report_pop((fn.num_name(_year) + ".pop").c_str());
-  if (!report_pop.good()) return false;
-  report_pop << COMMENT_CHAR << " populasjon" << std::endl << "Geografi     " <<  _geography << std::endl;
-  while (iter != cellMap.end()) {
-    std::list<BioSim::Species>::iterator it2 = species.begin();
-    while (it2 != species.end()) {
-      std::vector<BioSim::Animal*> beasts = ((*iter)->cellMates(&(*it2)));
-      if (beasts.size())
-        report_pop << (*it2).genus() << " " << (*iter)->x_pos() << " " << (*iter)->y_pos() << " " << beasts.size() << std::endl << beasts << std::endl;
-      it2++;
+  CellRange cellMap = geography.mapView(true);
+  std::shared_ptr<Population> snapshot(new Population());
+  snapshot->geography = _geography;
+  std::vector<unsigned short> ids;
+  for (std::list<BioSim::Species>::iterator it2 = species.begin(); it2 != species.end(); it2++) {
+    ids.push_back(animals.speciesId(&(*it2)));
+    snapshot->genera.push_back(it2->genus());
+  }
+  snapshot->records.reserve(animals.size());
+  for (CellRange::iterator iter = cellMap.begin(); iter != cellMap.end(); iter++) {
+    for (unsigned int g = 0; g < ids.size(); g++) {
+      AnimalRange beasts = (*iter)->inhabitants(ids[g]);
+      if (!beasts.size()) continue;
+      PopulationBlock block = {(uint32_t) (*iter)->x_pos(), (uint32_t) (*iter)->y_pos(), g, (uint32_t) beasts.size(), snapshot->records.size()};
+      for (AnimalRange::iterator iter2 = beasts.begin(); iter2 != beasts.end(); iter2++) {
+        Animal beast = *iter2;
+        PopulationRecord record = {beast.weight(), beast.alder(), 0};
+        snapshot->records.push_back(record);
+      }
+      snapshot->blocks.push_back(block);
     }
-    iter++;
-    if (!report_pop.good()) return false;
   }
-  report_pop.close();
-
+  std::string name = toolbox::Filename(dumpsite).num_name(_year) + ".pop";
+  reports.submit(name, [snapshot, name]() {
+    snapshot->writeText(name);
+    return true;
+  });
   return true;
 }
 
-/** @param os An output stream to write to.
+/** The counts are read from @c census, so the cost of a row does not depend on the number of Animals.
+ *  @param os An output stream to write to.
  *  @return The output stream on which to follow this report. (Same as @c os.)
  */
 std::ostream& BioSim::Simulation::reportPopulation(std::ostream &os) {
-  int prey_j = 0;
-  int pred_j = 0;
-  int prey_s = 0;
-  int pred_s = 0;
-  int prey_o = 0;
-  int pred_o = 0;
-
-  bool pred;
-  char cellType;
-
-  std::set<Animal*>::iterator iter = animals.begin();
-  while (iter != animals.end()) {
-    pred = (*iter)->genus()->predator();
-    cellType = (*iter)->location()->cellName();
-    switch (cellType) {
-      case 'J':
-        pred?pred_j++:prey_j++;
-        break;
-      case 'S':
-        pred?pred_s++:prey_s++;
-        break;
-      case 'O':
-        pred?pred_o++:prey_o++;
-        break;
+  unsigned int terrains = geography.terrains();
+  os << std::setw(5) << _year;
+  for (size_t c = 0; c < columns.size(); c++) {
+    long prey = 0;
+    long pred = 0;
+    if (columns[c] >= 0) {
+      for (unsigned short genus = 0; genus < allSpecies.size(); genus++) {
+        long count = census[genus * terrains + columns[c]];
+        if (allSpecies[genus]->predator())
+          pred += count;
+        else
+          prey += count;
+      }
     }
-    iter++;
+    os << std::setw(8) << prey << std::setw(8) << pred;
   }
-
-  return os
-    << std::setw(5) << _year
-    << std::setw(8) << prey_j
-    << std::setw(8) << pred_j
-    << std::setw(8) << prey_s
-    << std::setw(8) << pred_s
-    << std::setw(8) << prey_o
-    << std::setw(8) << pred_o
-    << std::endl;
+  return os << std::endl;
 }
@@ -0,0 +1,219 @@
+/** @file Fitness.cpp
+ *  @brief This file contains the batch fitness kernels and their run-time selection.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#include "Fitness.h"
+#include "Animal.h"
+#include <algorithm>
+
+/// Smallest number of intervals in a weight table.
+#define FITNESS_WEIGHTS_MIN 64
+/// Largest number of intervals in a weight table.
+#define FITNESS_WEIGHTS_MAX (1u << 20)
+/// Points per interval at which a weight table is checked.
+#define FITNESS_SAMPLES 8
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FITNESS_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+  /// Signature shared by the batch kernels.
+  typedef void (*FitnessKernel)(const BioSim::FitnessCurve &curve, const double *weight, const double *age, double *phi, size_t n);
+
+  /// Portable kernel; also finishes the tails left by the vector kernels.
+  void fitnessScalar(const BioSim::FitnessCurve &curve, const double *weight, const double *age, double *phi, size_t n) {
+    for (size_t i = 0; i < n; i++) phi[i] = BioSim::fitness(curve, weight[i], age[i]);
+  }
+
+#ifdef FITNESS_X86
+  /// BioSim::expq() on four lanes. Every step matches the scalar code.
+  __attribute__((target("avx2"))) inline __m256d expq4(__m256d x) {
+    x = _mm256_min_pd(x, _mm256_set1_pd(EXPQ_MAX));
+    x = _mm256_max_pd(x, _mm256_set1_pd(EXPQ_MIN));
+    __m256d t = _mm256_floor_pd(_mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(EXPQ_LOG2E)), _mm256_set1_pd(0.5)));
+    __m256d r = _mm256_sub_pd(x, _mm256_mul_pd(t, _mm256_set1_pd(EXPQ_LN2_HI)));
+    r = _mm256_sub_pd(r, _mm256_mul_pd(t, _mm256_set1_pd(EXPQ_LN2_LO)));
+    __m256d p = _mm256_set1_pd(1.0 / 6227020800.0);
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 479001600.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 39916800.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 3628800.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 362880.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 40320.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 5040.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 720.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 120.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 24.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0 / 6.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(0.5));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0));
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0));
+    __m256i e = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(t)), _mm256_set1_epi64x(1023));
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(_mm256_slli_epi64(e, 52)));
+  }
+
+  /// 1 / (1 + exp(k (x - x_half))) on four lanes.
+  __attribute__((target("avx2"))) inline __m256d q4(__m256d x, double x_half, double k) {
+    __m256d e = expq4(_mm256_mul_pd(_mm256_set1_pd(k), _mm256_sub_pd(x, _mm256_set1_pd(x_half))));
+    return _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_add_pd(_mm256_set1_pd(1.0), e));
+  }
+
+  __attribute__((target("avx2")))
+  void fitnessAVX2(const BioSim::FitnessCurve &curve, const double *weight, const double *age, double *phi, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m256d w = _mm256_loadu_pd(weight + i);
+      __m256d a = _mm256_loadu_pd(age + i);
+      __m256d f = _mm256_mul_pd(q4(a, curve.a_halv, curve.k_alder), q4(w, curve.v_halv_under, curve.k_under));
+      f = _mm256_mul_pd(f, q4(w, curve.v_halv_over, curve.k_over));
+      __m256d starved = _mm256_cmp_pd(w, _mm256_set1_pd(curve.v_min), _CMP_LT_OQ);
+      _mm256_storeu_pd(phi + i, _mm256_andnot_pd(starved, f));
+    }
+    fitnessScalar(curve, weight + i, age + i, phi + i, n - i);
+  }
+
+  /// BioSim::expq() on eight lanes. Every step matches the scalar code.
+  __attribute__((target("avx512f"))) inline __m512d expq8(__m512d x) {
+    x = _mm512_min_pd(x, _mm512_set1_pd(EXPQ_MAX));
+    x = _mm512_max_pd(x, _mm512_set1_pd(EXPQ_MIN));
+    __m512d t = _mm512_roundscale_pd(_mm512_add_pd(_mm512_mul_pd(x, _mm512_set1_pd(EXPQ_LOG2E)), _mm512_set1_pd(0.5)),
+                                     _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    __m512d r = _mm512_sub_pd(x, _mm512_mul_pd(t, _mm512_set1_pd(EXPQ_LN2_HI)));
+    r = _mm512_sub_pd(r, _mm512_mul_pd(t, _mm512_set1_pd(EXPQ_LN2_LO)));
+    __m512d p = _mm512_set1_pd(1.0 / 6227020800.0);
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0 / 479001600.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0 / 39916800.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0 / 3628800.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0 / 362880.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0 / 40320.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0 / 5040.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0 / 720.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0 / 120.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0 / 24.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0 / 6.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(0.5));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0));
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(1.0));
+    __m512i e = _mm512_add_epi64(_mm512_cvtepi32_epi64(_mm512_cvtpd_epi32(t)), _mm512_set1_epi64(1023));
+    return _mm512_mul_pd(p, _mm512_castsi512_pd(_mm512_slli_epi64(e, 52)));
+  }
+
+  /// 1 / (1 + exp(k (x - x_half))) on eight lanes.
+  __attribute__((target("avx512f"))) inline __m512d q8(__m512d x, double x_half, double k) {
+    __m512d e = expq8(_mm512_mul_pd(_mm512_set1_pd(k), _mm512_sub_pd(x, _mm512_set1_pd(x_half))));
+    return _mm512_div_pd(_mm512_set1_pd(1.0), _mm512_add_pd(_mm512_set1_pd(1.0), e));
+  }
+
+  __attribute__((target("avx512f")))
+  void fitnessAVX512(const BioSim::FitnessCurve &curve, const double *weight, const double *age, double *phi, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m512d w = _mm512_loadu_pd(weight + i);
+      __m512d a = _mm512_loadu_pd(age + i);
+      __m512d f = _mm512_mul_pd(q8(a, curve.a_halv, curve.k_alder), q8(w, curve.v_halv_under, curve.k_under));
+      f = _mm512_mul_pd(f, q8(w, curve.v_halv_over, curve.k_over));
+      __mmask8 fed = _mm512_cmp_pd_mask(w, _mm512_set1_pd(curve.v_min), _CMP_GE_OQ);
+      _mm512_storeu_pd(phi + i, _mm512_maskz_mov_pd(fed, f));
+    }
+    fitnessScalar(curve, weight + i, age + i, phi + i, n - i);
+  }
+#endif
+
+  /// Selects the widest kernel the processor supports.
+  FitnessKernel selectKernel(const char **name) {
+#ifdef FITNESS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) { *name = "avx512"; return fitnessAVX512; }
+    if (__builtin_cpu_supports("avx2"))    { *name = "avx2";   return fitnessAVX2; }
+#endif
+    *name = "scalar";
+    return fitnessScalar;
+  }
+
+  const char *kernelName = "scalar";               ///< Name of the selected kernel.
+  const FitnessKernel kernel = selectKernel(&kernelName); ///< The selected kernel.
+}
+
+/** All kernels give exactly the same results as BioSim::fitness(const FitnessCurve&, double, double), lane by lane.
+ *  With a weight table the fitness is two lookups and a multiplication, which the scalar kernel does best.
+ *  @param curve  The fitness parameters of the Species.
+ *  @param weight The weights of the Animals.
+ *  @param age    The ages of the Animals.
+ *  @param phi    Receives the fitness of the Animals.
+ *  @param n      The number of Animals.
+ */
+void BioSim::fitness(const FitnessCurve &curve, const double *weight, const double *age, double *phi, size_t n) {
+  if (curve.q_vekt.empty())
+    kernel(curve, weight, age, phi, n);
+  else
+    fitnessScalar(curve, weight, age, phi, n);
+}
+
+/// The age table holds the very values the exact computation gives, so it does not change any result.
+void BioSim::FitnessCurve::tabulate() {
+  q_alder.resize(FITNESS_AGES);
+  for (unsigned int age = 0; age < FITNESS_AGES; age++) {
+    q_alder[age] = 1.0 / (1.0 + expq(k_alder * (age - a_halv)));
+  }
+  q_vekt.clear();
+  v_scale = 0.0;
+  v_max = v_min;
+}
+
+/** The weight table spans from v_min to where the overweight factor falls below half the tolerance. It starts with
+ *  FITNESS_WEIGHTS_MIN intervals, whose number is doubled, halving their width, until the interpolation error, sampled at
+ *  FITNESS_SAMPLES points per interval, is within the tolerance. If that takes more than FITNESS_WEIGHTS_MAX intervals,
+ *  or the factors do not fall off, only the age table is kept.
+ *  @param tolerance The largest acceptable error in the fitness; 0 or less for no weight table.
+ *  @return The largest error found, or 0 if there is no weight table.
+ */
+double BioSim::FitnessCurve::tabulate(double tolerance) {
+  tabulate();
+  if (tolerance <= 0.0 || k_over <= 0.0) return 0.0;
+  double top = v_halv_over + std::log(2.0 / tolerance) / k_over;
+  if (top <= v_min) return 0.0;
+  for (size_t intervals = FITNESS_WEIGHTS_MIN; intervals <= FITNESS_WEIGHTS_MAX; intervals *= 2) {
+    v_scale = intervals / (top - v_min);
+    v_max = v_min + intervals / v_scale;
+    std::vector<double> table(intervals + 1);
+    for (size_t i = 0; i <= intervals; i++) {
+      double weight = v_min + i / v_scale;
+      table[i] = (1.0 / (1.0 + expq(k_under * (weight - v_halv_under)))) * (1.0 / (1.0 + expq(k_over * (weight - v_halv_over))));
+    }
+    q_vekt.swap(table);
+    double error = deviation();
+    if (error <= tolerance) return error;
+  }
+  tabulate();
+  return 0.0;
+}
+
+/** Compares the tables with the product of func_q() factors that Species::fitness() was originally defined as; the weight
+ *  table is sampled at FITNESS_SAMPLES points per interval. Since the age factor is at most 1, the result bounds the error in the fitness.
+ *  @return The largest absolute difference found.
+ */
+double BioSim::FitnessCurve::deviation() {
+  double error = 0.0;
+  for (size_t age = 0; age < q_alder.size(); age++) {
+    error = std::max(error, std::fabs(q_alder[age] - func_q(age, a_halv, k_alder, true)));
+  }
+  if (q_vekt.empty()) return error;
+  size_t samples = (q_vekt.size() - 1) * FITNESS_SAMPLES;
+  for (size_t i = 0; i < samples; i++) {
+    double weight = v_min + (i + 0.5) / (samples / (v_max - v_min));
+    double exact = func_q(weight, v_halv_under, -k_under, false) * func_q(weight, v_halv_over, k_over, true);
+    error = std::max(error, std::fabs(weightTerm(weight) - exact));
+  }
+  return error;
+}
+
+/// @return "avx512", "avx2" or "scalar".
+const char *BioSim::fitnessKernel() {
+  return kernelName;
+}
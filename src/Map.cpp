@@ -15,29 +15,31 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
 #include "random.h"
+#include <thread>
+#include <atomic>
 
-/** Coordinates are packed by left-shifting the x-value 0x10 steps (half a 32-bit word) and adding the y-value.
- *  For simplicity in this step, all values are passed and returned as unsigned int. This packing method has the
- *  benefit of having x-values in the most significant bytes; therefore an ordered list of coordinates will be
- *  in such a way that looking them up in order gives a row-first traversal of the map.
+/** Coordinates are packed by left-shifting the x-value 0x20 steps (half a 64-bit word) and adding the y-value.
+ *  Each component keeps its full 32 bits, so the packing places no limit on the size of a Map beyond that of unsigned int.
+ *  Packed coordinates are only used to pass coordinate pairs around; the Map itself is addressed by Cell index.
  *  @param x x-value of the coordinate to pack
  *  @param y y-value of the coordinate to pack
  *  @return The coordinates packed into a single unsigned integer.
  */
-unsigned int BioSim::coordPack (unsigned int x, unsigned int y) {
-  return ((x << 0x10) + y);
+unsigned long long BioSim::coordPack (unsigned int x, unsigned int y) {
+  return (((unsigned long long) x << 0x20) + y);
 }
 
 /** Coordinates are unpacked by what is essentially the opposite of packing; the x-value is assigned by right-shifting,
- *  and the y-value is assigned by binary and'ing the packed value against 0xFFFF.
+ *  and the y-value is assigned by binary and'ing the packed value against 0xFFFFFFFF.
  *  @param coord The value of the coordinate pack.
  *  @param x     A reference to an unsigned int that will be filled by the x value.
  *  @param y     A reference to an unsigned int that will be filled by the y value.
  */
-void BioSim::coordUnpack (unsigned int coord, unsigned int &x, unsigned int &y) {
-  x = (coord >> 0x10);
-  y = (coord & 0xFFFF);
+void BioSim::coordUnpack (unsigned long long coord, unsigned int &x, unsigned int &y) {
+  x = (unsigned int) (coord >> 0x20);
+  y = (unsigned int) (coord & 0xFFFFFFFFull);
 }
 
 bool BioSim::ArchCell::operator< (ArchCell &b) {
@@ -53,6 +55,11 @@ bool BioSim::Cell::operator< (Cell &b) {
  */
 BioSim::Cell::Cell() {
   archetype = NULL;
+  _store = NULL;
+  _index = CELL_NONE;
+  _headcount = 0;
+  _dirty = true;
+  for (int i = 0; i < 4; i++) _neighbours[i] = NULL;
 }
 
 /** This is the only valid initializer for Cell objects.
@@ -61,6 +68,11 @@ BioSim::Cell::Cell() {
 BioSim::Cell::Cell(ArchCell *type) {
   archetype = type;
   feed = archetype->maxfeed();
+  _store = NULL;
+  _index = CELL_NONE;
+  _headcount = 0;
+  _dirty = true;
+  for (int i = 0; i < 4; i++) _neighbours[i] = NULL;
 }
 
 /** This function returns the one-letter cell name for the terrain type.
@@ -70,6 +82,11 @@ char BioSim::Cell::cellName() {
   return archetype->name();
 }
 
+/// @return The number of the terrain type of the Cell; see BioSim::Map::terrain().
+unsigned int BioSim::Cell::terrain() {
+  return archetype->terrain();
+}
+
 /** This function returns the ammount of available feed for the Cell.
  *  @return The feed ammount in the Cell.
  */
@@ -82,6 +99,7 @@ double BioSim::Cell::graze() {
  *  @return The available ammount of feed.
  */
 double BioSim::Cell::graze(double ammount) {
+  if (ammount > 0 && feed > 0) _dirty = true;
   if (feed >= ammount) {
     feed -= ammount;
     return ammount;
@@ -92,24 +110,13 @@ double BioSim::Cell::graze(double ammount) {
   }
 }
 
-/// This function iterates through all Animals in the Cell, causing each of them to attempt to wander to a neighbouring cell.
-void BioSim::Cell::wander() {
-  if (habitants.size() == 0) return;
-  /// Creates a copy of the current habitants of the cell.
-  /// This ensures that all animals will be moved, and that the iterator won't be thrown off by movement.
-  std::vector<Animal *> habitantsCopy(habitants.begin(),habitants.end());
-  std::vector<Animal *>::iterator iter = habitantsCopy.begin();
-  while (iter != habitantsCopy.end()) {
-    (*iter++)->wander();
-  }
-}
-
 /// This function creates a Zombie archcell. ArchCell instances created by this function are only interesting for debugging purposes.
 BioSim::ArchCell::ArchCell() {
   _name = '?';
   _alpha = 0.0;
   _maxfeed = 0.0;
   _live = 0;
+  _terrain = 0;
 }
 
 /** This function creates a viable ArchCell instance usable in the simulation proper.
@@ -123,6 +130,7 @@ BioSim::ArchCell::ArchCell(char _n, double _a, int _mf, bool _l) {
   _alpha = _a;
   _maxfeed = _mf;
   _live = _l;
+  _terrain = 0;
 #ifdef BIOSIM_PNG
   _color.red   = 0;
   _color.green = 0;
@@ -197,13 +205,18 @@ void BioSim::ArchCell::color(const std::string &colorRep) {
 
 /** This function causes the Cell to regrow its food. */
 void BioSim::Cell::regrow() {
-  feed += archetype->alpha() * (archetype->maxfeed() - feed);
+  double grown = feed + archetype->alpha() * (archetype->maxfeed() - feed);
+  if (grown != feed) _dirty = true;
+  feed = grown;
 }
 
 /** This function makes a viable map for use in simulations. After the Map has been created with this function,
  *  it needs to be initialized with BioSim::Map::initArch() or BioSim::Map::initSpec() and BioSim::Map::init(), in that order.
  */
 BioSim::Map::Map() : param_reader_(COMMENT_CHAR) {
+#ifdef BIOSIM_PNG
+  mapImageBuffer = NULL;
+#endif
   param_reader_.register_param("alpha", _alpha);
   param_reader_.register_param("fmax_sav", _fmax_sav);
   param_reader_.register_param("fmax_jngl", _fmax_jngl);
@@ -293,50 +306,72 @@ void BioSim::Map::init(const std::string &geography) {
     else if ( mapstream.fail() )
       throw std::runtime_error("Map::init(): read error");
   }
-  std::vector<unsigned int> tmpAdrMap;
+  // The terrain types are numbered in order of name, for per-terrain tallies.
+  _terrains.clear();
+  for (std::map<char,ArchCell>::iterator type = archetypes.begin(); type != archetypes.end(); type++) {
+    type->second.terrain(_terrains.size());
+    _terrains.push_back(&type->second);
+  }
+  // The Cells are stored row by row, so that the Cell at x, y has index y * _cols + x.
+  // The vector is sized once; pointers to Cells stay valid for the lifetime of the Map.
+  cells.clear();
+  _adrMap.clear();
+  cells.reserve((size_t) _rows * _cols);
   for (unsigned int y = 0; y < _rows; y++) {
     for (unsigned int x = 0; x < _cols; x++) {
       if (!mapstream) throw std::runtime_error("Map::init(): read error");
       char value;
       mapstream >> value;
-      unsigned int coord = BioSim::coordPack(x,y);
-      BioSim::ArchCell* type = &archetypes[value];
-      if (type->name() != value) throw std::runtime_error(std::string("Map::init(): undefined terrain type: " + std::string(1,value)));
-      cells[coord] = BioSim::Cell(type);
-      cells[coord].x_pos(x);
-      cells[coord].y_pos(y);
-      if (type->live()) _adrMap.push_back(&(cells[coord]));
-      _fullAdrMap.push_back(&(cells[coord]));
-      tmpAdrMap.push_back(coord);
+      std::map<char,ArchCell>::iterator type = archetypes.find(value);
+      if (type == archetypes.end()) throw std::runtime_error(std::string("Map::init(): undefined terrain type: " + std::string(1,value)));
+      unsigned int index = cells.size();
+      cells.push_back(BioSim::Cell(&type->second));
+      cells[index].x_pos(x);
+      cells[index].y_pos(y);
+      cells[index].index(index);
+      if (type->second.live()) _adrMap.push_back(index);
     }
   }
-  for (std::vector<unsigned int>::iterator iter = tmpAdrMap.begin(); iter != tmpAdrMap.end(); iter++) {
-    cells[(*iter)].neighbours(candidatesAt(*iter));
+  for (unsigned int y = 0; y < _rows; y++) {
+    for (unsigned int x = 0; x < _cols; x++) {
+      cells[index(x,y)].neighbours(candidatesAt(x,y));
+    }
   }
+  partition(MAP_TILE);
 #ifdef BIOSIM_PNG
   initMapImageBuffer();
 #endif
 }
 
-/** This function returns the cell at the point represented by the packed coordinates coord. This function performs no error checking, and will happily
- *  provide an invalid autovivified cell.
+/** This function wraps BioSim::Map::at(unsigned int, unsigned int) for use with packed coordinates.
  *  @param coord A packed coordinate pair, as produced by BioSim::coordPack().
- *  @return A pointer to the Cell at coord.
+ *  @return A pointer to the Cell at coord, or @c NULL if coord is outside the Map.
  */
-BioSim::Cell * BioSim::Map::at(unsigned int coord) {
-  return &cells[coord];
+BioSim::Cell * BioSim::Map::at(unsigned long long coord) {
+  unsigned int x;
+  unsigned int y;
+  BioSim::coordUnpack(coord, x, y);
+  return at(x, y);
 }
 
-/** This is a convencience function that wraps BioSim::Map::at(unsigned int) for use with unpacked coordinates. Despite the additional overhead incurred
- *  by its use, this function is preferable to the former, in that this function is error-checked; it will never expand the map if the given coordinates
- *  do not point at an existing cell.
+/** This function returns the Cell at x,y by index arithmetic; the lookup takes constant time regardless of the size of the Map.
  *  @param x x component of the desired coordinate.
  *  @param y y component of the desired coordinate.
- *  @return A pointer to the Cell at x,y.
+ *  @return A pointer to the Cell at x,y, or @c NULL if x,y is outside the Map.
  */
 BioSim::Cell * BioSim::Map::at(unsigned int x, unsigned int y) {
   if (x >= _cols || y >= _rows) return NULL;
-  return at(BioSim::coordPack(x,y));
+  return &cells[index(x,y)];
+}
+
+/** Informs every Cell of the AnimalStore holding the Animals that inhabit it. Must be called after BioSim::Map::init().
+ *  @param store The AnimalStore.
+ */
+void BioSim::Map::population(BioSim::AnimalStore *store) {
+  std::vector<Cell>::iterator iter;
+  for (iter = cells.begin(); iter != cells.end(); iter++) {
+    iter->population(store);
+  }
 }
 
 /** Utility function used in Map initialization to inform Cell objects of their neighbours.
@@ -369,19 +404,19 @@ std::vector<BioSim::Cell*> BioSim::Map::candidatesAt(unsigned int x, unsigned in
  *  @param     x The x-coordinate of the desired cell.
  *  @param     y The y-coordinate of the desired cell.
  *  @param beast A beast with the desired Species.
- *  @return      A vector of pointers to Animal objects in the Cell with the same Species as beast.
+ *  @return      A vector of Animal objects in the Cell with the same Species as beast.
  */
-std::vector<BioSim::Animal *> BioSim::Map::cellMates(BioSim::Animal *beast, unsigned int x, unsigned int y) {
-  return cellMates(beast->genus(), x, y);
+std::vector<BioSim::Animal> BioSim::Map::cellMates(BioSim::Animal beast, unsigned int x, unsigned int y) {
+  return cellMates(beast.genus(), x, y);
 }
 
 /** This function wraps BioSim::Cell::cellMates(Species*), and is strictly a utility function for debugging purposes; in normal operation it should not be called. 
  *  @param     x The x-coordinate of the desired cell.
  *  @param     y The y-coordinate of the desired cell.
  *  @param genus The desired Species.
- *  @return      A vector of pointers to Animal objects in the Cell with the Species genus.
+ *  @return      A vector of Animal objects in the Cell with the Species genus.
  */
-std::vector<BioSim::Animal *> BioSim::Map::cellMates(BioSim::Species *genus, unsigned int x, unsigned int y) {
+std::vector<BioSim::Animal> BioSim::Map::cellMates(BioSim::Species *genus, unsigned int x, unsigned int y) {
   return at(x,y)->cellMates(genus);
 }
 
@@ -390,56 +425,81 @@ std::vector<BioSim::Animal *> BioSim::Map::cellMates(BioSim::Species *genus, uns
  *  @param breedersOnly When enabled, only animals with age > 0 will be returned.
  *  @return A vector of Animal pointers.
  */
-std::vector<BioSim::Animal *> BioSim::Cell::cellMates(BioSim::Animal *beast, bool breedersOnly) {
-  return cellMates(beast->genus(), breedersOnly);
+std::vector<BioSim::Animal> BioSim::Cell::cellMates(BioSim::Animal beast, bool breedersOnly) {
+  return cellMates(beast.genus(), breedersOnly);
 }
 
 /** This function returns a vector of Animal pointers inhabiting the Cell of Species genus.
  *  @param genus A pointer to the desired Species.
  *  @param breedersOnly When enabled, only animals with age > 0 will be returned.
- *  @return A vector of Animal pointers.
+ *  @return A vector of Animals.
  */
-std::vector<BioSim::Animal *> BioSim::Cell::cellMates(BioSim::Species *genus, bool breedersOnly) {
-  int minAge = 0;
-  if (breedersOnly)
-    minAge = 1;
-  std::set<BioSim::Animal *>::iterator iter;
-  std::vector<BioSim::Animal *> retval;
-  for (iter = habitants.begin(); iter != habitants.end(); iter++) {
-    if ((*iter)->genus() == genus && (*iter)->alder() >= minAge)
-      retval.push_back(*iter);
+std::vector<BioSim::Animal> BioSim::Cell::cellMates(BioSim::Species *genus, bool breedersOnly) {
+  unsigned short genusId = _store->speciesId(genus);
+  unsigned int count = headcount(genusId, breedersOnly);
+  std::vector<BioSim::Animal> retval;
+  retval.reserve(count);
+  for (unsigned int i = 0; i < count; i++) {
+    retval.push_back(habitant(genusId, i));
   }
   return retval;
 }
 
-/** @param genera A vector of Species for which breeding is interesting.
- *  @return A vector to pointers of newly created Animals.
+/** The view is invalidated when Animals of the species enter or leave the Cell.
+ *  @param genus A species id.
+ *  @param breedersOnly When enabled, only animals with age > 0 are included.
+ *  @return A view of the inhabitant Animals of species id genus.
  */
-std::vector<BioSim::Animal *> BioSim::Cell::breed(std::vector<BioSim::Species*> genera) {
-  std::vector<Animal *> retval;
-  std::vector<Species*>::iterator iter = genera.begin();
+BioSim::AnimalRange BioSim::Cell::inhabitants(unsigned short genus, bool breedersOnly) {
+  if (genus >= habitants.size()) return AnimalRange();
+  return AnimalRange(_store, Span<const AnimalHandle>(habitants[genus].beasts.data(), headcount(genus, breedersOnly)));
+}
+
+/** Iterating from 0 to headcount(genus, true) visits exactly the breeders; no filtering is needed.
+ *  @param genus A species id.
+ *  @param breedersOnly When enabled, only animals with age > 0 are counted.
+ *  @return The number of inhabitant Animals of species id genus.
+ */
+unsigned int BioSim::Cell::headcount(unsigned short genus, bool breedersOnly) {
+  if (genus >= habitants.size()) return 0;
+  Bucket &bucket = habitants[genus];
+  return bucket.beasts.size() - (breedersOnly ? bucket.juveniles : 0);
+}
+
+/** Breeders are numbered before Animals of age 0. Numbers change when Animals of the same species enter or leave the Cell.
+ *  @param genus A species id.
+ *  @param i     A number below headcount(genus).
+ *  @return The Animal.
+ */
+BioSim::Animal BioSim::Cell::habitant(unsigned short genus, unsigned int i) {
+  return Animal(_store, habitants[genus].beasts[i]);
+}
+
+/** The parents lose their birth weight, but the newborns are not created; instead their species ids are appended to @c litter.
+ *  Only the Cell and its inhabitants are modified.
+ *  @param genera A vector of Species for which breeding is interesting.
+ *  @param rng    The random stream to draw from.
+ *  @param litter Receives the species id of each newborn.
+ */
+void BioSim::Cell::breed(const std::vector<BioSim::Species*> &genera, toolbox::RandomStream &rng, std::vector<unsigned short> &litter) {
+  std::vector<Species*>::const_iterator iter;
   for (iter = genera.begin(); iter != genera.end(); iter++) {
-    std::vector<Animal*> theseBeasts = cellMates(*iter);
-    int largeN = theseBeasts.size();
-    std::vector<Animal*>::iterator beastIter;
-    for (beastIter = theseBeasts.begin(); beastIter != theseBeasts.end(); beastIter++) {
-      double birthchance = (*iter)->birthChance((*beastIter),largeN);
-      Animal *offspring = NULL;
-      if ((toolbox::randomGen().drand() < birthchance)) {
-        offspring = (*beastIter)->breed();
-      }
-      if (offspring)
-        retval.push_back(offspring);
+    unsigned short genusId = _store->speciesId(*iter);
+    int largeN = headcount(genusId);
+    for (int i = 0; i < largeN; i++) {
+      Animal beast = habitant(genusId, i);
+      double birthchance = (*iter)->birthChance(beast,largeN);
+      if ((rng.drand() < birthchance) && beast.conceive())
+        litter.push_back(genusId);
     }
   }
-  return retval;
 }
 
 /** This function wraps BioSim::Map::candidatesAt(unsigned int, unsigned int) for used with packed coordinates.
  *  @param coord the desired coordinate pair packed with BioSim::coordPack()
  *  @return A vector of Cell pointers.
  */
-std::vector<BioSim::Cell*> BioSim::Map::candidatesAt(unsigned int coord) {
+std::vector<BioSim::Cell*> BioSim::Map::candidatesAt(unsigned long long coord) {
   unsigned int x;
   unsigned int y;
   BioSim::coordUnpack(coord, x, y);
@@ -451,41 +511,255 @@ std::vector<BioSim::Cell*> BioSim::Map::candidatesAt(unsigned int coord) {
  */
 bool BioSim::Cell::addAnimal() { return archetype->live(); }
 
-/** Adds the Animal to the Cell.
- *  @param beast A pointer to the Animal to add.
+/** Moves the handle at position @c from of a Bucket to position @c to, and records the new position.
+ *  @param bucket The Bucket.
+ *  @param from   The current position of the handle.
+ *  @param to     The new position of the handle.
+ */
+void BioSim::Cell::shift(Bucket &bucket, unsigned int from, unsigned int to) {
+  AnimalHandle beast = bucket.beasts[from];
+  bucket.beasts[to] = beast;
+  _store->place(beast) = to;
+}
+
+/** Adds the Animal to the Cell. The Animal must not already be in the Cell; BioSim::Animal::moveTo() takes care of this.
+ *  A breeder entering a Bucket that holds Animals of age 0 takes the place of the first of them, which is moved to the end.
+ *  @param beast The Animal to add.
  *  @return True if the animal is successfully added to the cell.
  */
-bool BioSim::Cell::addAnimal(Animal *beast) {
+bool BioSim::Cell::addAnimal(Animal beast) {
   if (!archetype->live()) return false;
-  habitants.insert(beast);
+  AnimalHandle handle = beast.handle();
+  unsigned short genus = _store->genus(handle);
+  if (genus >= habitants.size()) habitants.resize(genus + 1);
+  Bucket &bucket = habitants[genus];
+  unsigned int size = bucket.beasts.size();
+  bucket.beasts.push_back(handle);
+  if (_store->alder(handle) == 0) {
+    bucket.juveniles++;
+    _store->place(handle) = size;
+  } else {
+    unsigned int firstJuvenile = size - bucket.juveniles;
+    shift(bucket, firstJuvenile, size);
+    bucket.beasts[firstJuvenile] = handle;
+    _store->place(handle) = firstJuvenile;
+  }
+  _headcount++;
+  _dirty = true;
   return true;
 }
 
-/** Removes an Animal from the Cell.
- *  @param beast A pointer to the Animal to remove.
+/** Removes an Animal from the Cell in constant time. The hole is filled by the last Animal of the same group (breeders or
+ *  Animals of age 0) in the Bucket; if a breeder is removed, the last Animal of age 0 in turn takes the place of the last breeder.
+ *  @param beast The Animal to remove.
  */
-void BioSim::Cell::removeAnimal(Animal *beast) {
-  habitants.erase(beast);
+void BioSim::Cell::removeAnimal(Animal beast) {
+  AnimalHandle handle = beast.handle();
+  Bucket &bucket = habitants[_store->genus(handle)];
+  unsigned int hole = _store->place(handle);
+  unsigned int last = bucket.beasts.size() - 1;
+  unsigned int breeders = bucket.beasts.size() - bucket.juveniles;
+  if (hole < breeders) {
+    shift(bucket, breeders - 1, hole);
+    if (bucket.juveniles) shift(bucket, last, breeders - 1);
+  } else {
+    shift(bucket, last, hole);
+    bucket.juveniles--;
+  }
+  bucket.beasts.pop_back();
+  _headcount--;
+  _dirty = true;
 }
 
-/// @return A vector with pointers to the Animals inhabiting the Cell.
-std::vector<BioSim::Animal *> BioSim::Cell::animals() {
-  return std::vector<BioSim::Animal *>(habitants.begin(),habitants.end());
+/// Must be called when every Animal in the Cell has gone from age 0 to a greater age; BioSim::Simulation::ageTile() takes care of this.
+void BioSim::Cell::matureAll() {
+  for (unsigned short genus = 0; genus < habitants.size(); genus++) habitants[genus].juveniles = 0;
 }
 
-/**
- *  @param allcells Indicates whether a mapMap of all Map Cells is wanted.
- *  @return A vector containing packed coordinates as produced by BioSim::coordPack().
+/// The Animals are left as they are in the AnimalStore; this is meant for rebuilding the Cell with settle().
+void BioSim::Cell::evict() {
+  habitants.clear();
+  _headcount = 0;
+  _dirty = true;
+}
+
+/** Unlike addAnimal(), this puts the Animal exactly at AnimalStore::place(), so that a Cell can be rebuilt in its original
+ *  order from a saved AnimalStore. Animals of age 0 must be placed after the breeders of their species.
+ *  @param beast The Animal to place; its Cell index must be the index of this Cell.
+ */
+void BioSim::Cell::settle(AnimalHandle beast) {
+  unsigned short genus = _store->genus(beast);
+  unsigned int place = _store->place(beast);
+  if (genus >= habitants.size()) habitants.resize(genus + 1);
+  Bucket &bucket = habitants[genus];
+  if (place >= bucket.beasts.size()) bucket.beasts.resize(place + 1, ANIMAL_NONE);
+  bucket.beasts[place] = beast;
+  if (_store->alder(beast) == 0) bucket.juveniles++;
+  _headcount++;
+  _dirty = true;
+}
+
+/** Removes any number of Animals of one species id in a single pass. The survivors are moved up in place and keep their
+ *  order, breeders still ahead of Animals of age 0; only those that actually move have their place rewritten.
+ *  The removed Animals are left outside any Cell, but are not destroyed.
+ *  @param genus  The species id.
+ *  @param doomed One flag for each inhabitant of the species id, in the order of inhabitants(); non-zero marks an Animal to remove.
+ *  @param dead   The handles of the removed Animals are appended to this.
+ *  @return The number of Animals removed.
+ */
+unsigned int BioSim::Cell::cull(unsigned short genus, const unsigned char *doomed, std::vector<AnimalHandle> &dead) {
+  Bucket &bucket = habitants[genus];
+  unsigned int size = bucket.beasts.size();
+  unsigned int breeders = size - bucket.juveniles;
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < size; i++) {
+    AnimalHandle beast = bucket.beasts[i];
+    if (doomed[i]) {
+      dead.push_back(beast);
+      _store->loci(beast) = CELL_NONE;
+      if (i >= breeders) bucket.juveniles--;
+    } else {
+      if (kept != i) {
+        bucket.beasts[kept] = beast;
+        _store->place(beast) = kept;
+      }
+      kept++;
+    }
+  }
+  bucket.beasts.resize(kept);
+  _headcount -= size - kept;
+  if (kept != size) _dirty = true;
+  return size - kept;
+}
+
+/// @return A vector with the Animals inhabiting the Cell, grouped by species.
+std::vector<BioSim::Animal> BioSim::Cell::animals() {
+  std::vector<BioSim::Animal> retval;
+  retval.reserve(_headcount);
+  for (unsigned short genus = 0; genus < habitants.size(); genus++) {
+    std::vector<AnimalHandle>::iterator iter;
+    for (iter = habitants[genus].beasts.begin(); iter != habitants[genus].beasts.end(); iter++) {
+      retval.push_back(Animal(_store, *iter));
+    }
+  }
+  return retval;
+}
+
+/** This function copies BioSim::Map::mapView() into a vector.
+ *  @param allcells Indicates whether a mapMap of all Map Cells is wanted. If so, the Cells are given in index order; otherwise only the live Cells are given, also in index order.
+ *  @return A vector containing pointers to Cells.
  */
 std::vector<BioSim::Cell*> BioSim::Map::mapMap(bool allcells) {
-  if (allcells) return _fullAdrMap;
-  std::vector<Cell*>::iterator iter;
-  std::random_shuffle(_adrMap.begin(), _adrMap.end());
-  return _adrMap;
+  CellRange view = mapView(allcells);
+  std::vector<Cell*> retval(view.size());
+  std::copy(view.begin(), view.end(), retval.begin());
+  return retval;
+}
+
+/** @param name The name of the terrain type, as in the cell specification.
+ *  @return The ArchCell shared by every Cell of the type, or @c NULL if there is no such type.
+ */
+BioSim::ArchCell *BioSim::Map::archetype(char name) {
+  std::map<char,ArchCell>::iterator found = archetypes.find(name);
+  return found == archetypes.end() ? NULL : &found->second;
+}
+
+/** @param allcells Indicates whether all Map Cells are wanted. If so, the Cells are given in index order; otherwise only the live Cells are given, also in index order.
+ *  @return A view of the Cells.
+ */
+BioSim::CellRange BioSim::Map::mapView(bool allcells) {
+  if (allcells) return CellRange(cells.data(), cells.size());
+  return CellRange(cells.data(), Span<const unsigned int>(_adrMap.data(), _adrMap.size()));
+}
+
+/** Used after the AnimalStore has been read from a checkpoint. Each Animal is placed in the Cell and at the place recorded in the store.
+ *  @param store The AnimalStore; it must be the one set with population().
+ */
+void BioSim::Map::resettle(AnimalStore *store) {
+  for (size_t i = 0; i < cells.size(); i++) cells[i].evict();
+  AnimalHandle slots = store->slots();
+  for (AnimalHandle beast = 0; beast < slots; beast++) {
+    if (!store->valid(beast)) continue;
+    unsigned int loci = store->loci(beast);
+    if (loci >= cells.size() || !cells[loci].addAnimal())
+      throw std::runtime_error("Map::resettle(): Animal outside the live Cells.");
+    cells[loci].settle(beast);
+  }
+  for (size_t i = 0; i < cells.size(); i++) {
+    for (unsigned short genus = 0; genus < cells[i].genera(); genus++) {
+      Span<const AnimalHandle> handles = cells[i].inhabitants(genus).handles();
+      if (std::find(handles.begin(), handles.end(), ANIMAL_NONE) != handles.end())
+        throw std::runtime_error("Map::resettle(): inconsistent places.");
+    }
+  }
+}
+
+/** Tiles are the units of work of a multithreaded Simulation step. They are numbered row by row, and tiles without live
+ *  Cells are left out. Cells outside any tile, that is, dead Cells, are given tile number tiles().
+ *  @param side The side length of a tile, in Cells.
+ */
+void BioSim::Map::partition(unsigned int side) {
+  if (side == 0) side = 1;
+  unsigned int across = (_cols + side - 1) / side;
+  unsigned int down = (_rows + side - 1) / side;
+  _tileCells.clear();
+  _tileStart.assign(1, 0);
+  _tileOf.assign(cells.size(), 0);
+  for (unsigned int ty = 0; ty < down; ty++) {
+    for (unsigned int tx = 0; tx < across; tx++) {
+      unsigned int first = _tileCells.size();
+      for (unsigned int y = ty * side; y < std::min(_rows, (ty + 1) * side); y++) {
+        for (unsigned int x = tx * side; x < std::min(_cols, (tx + 1) * side); x++) {
+          unsigned int i = index(x, y);
+          if (!cells[i].addAnimal()) continue;
+          _tileOf[i] = _tileStart.size() - 1;
+          _tileCells.push_back(i);
+        }
+      }
+      if (_tileCells.size() > first) _tileStart.push_back(_tileCells.size());
+    }
+  }
+  for (unsigned int i = 0; i < cells.size(); i++) {
+    if (!cells[i].addAnimal()) _tileOf[i] = tiles();
+  }
 }
 
 #ifdef BIOSIM_PNG
 
+/// The headcount from which animalDensity() shows the darkest shade.
+#define ANIMAL_SHADES (0x1FE / 3)
+
+/** @param headcount The number of Animals in a live Cell.
+ *  @return The color of animalDensity().
+ */
+static png_color animalShade(unsigned int headcount) {
+  png_color retval = {0,0,0};
+  int scale = std::min(headcount, (unsigned int) ANIMAL_SHADES) * 0x3;
+  if (scale < 0xff) {
+    retval.red   = scale;
+    retval.blue  = 0xff;
+  } else {
+    retval.red   = 0xff;
+    retval.blue  = 0x1FE - scale;
+  }
+  return retval;
+}
+
+/** @param colorPart The food density on a scale from 0 to 0x1FE, as returned by BioSim::Cell::foodLevel().
+ *  @return The color of foodDensity().
+ */
+static png_color foodShade(int colorPart) {
+  png_color retval = {0,0,0};
+  if (colorPart < 0xff) {
+    retval.red   = 0xff;
+    retval.blue  = colorPart;
+  } else {
+    retval.red   = 0x1FE - colorPart;
+    retval.blue  = 0xff;
+  }
+  return retval;
+}
+
 /** This function initializes an image buffer for consumption by libpng methods.
  *  This function uses malloc() and friends rather than new/delete for simpler management and C compatibilty.
  */
@@ -497,11 +771,16 @@ void BioSim::Map::initMapImageBuffer() {
     throw std::runtime_error("Image memory could not be allocated.");
   }
 
+  _animalShades.resize(ANIMAL_SHADES + 1);
+  for (unsigned int i = 0; i <= ANIMAL_SHADES; i++) _animalShades[i] = animalShade(i);
+  _foodShades.resize(0x1FF);
+  for (int i = 0; i <= 0x1FE; i++) _foodShades[i] = foodShade(i);
+
   png_color blackColor = {0,0,0};
   png_size_t  colBytes = (imageCols * 3); // Each pixel is 3 bytes in size.
   png_bytep  blackLine = (png_bytep) calloc(colBytes,sizeof(png_byte));
 
-  std::vector<Cell*>::iterator mapMapIter = _fullAdrMap.begin();
+  std::vector<Cell>::iterator mapMapIter = cells.begin();
 
   for (int i = 0; i < imageRows; i++) {
     switch (i % 13) {
@@ -513,7 +792,7 @@ void BioSim::Map::initMapImageBuffer() {
 
         for (int j = 0; j < imageCols; j++) {
           if (j % 13) {
-            png_color thisCell = (*mapMapIter)->color();
+            png_color thisCell = mapMapIter->color();
             memcpy(&mapImageBuffer[i][j*3],&thisCell,3);
           } else {
             memcpy(&mapImageBuffer[i][j*3],&blackColor,3);
@@ -547,75 +826,59 @@ void BioSim::Map::initMapImageBuffer() {
  */
 png_color BioSim::Cell::animalDensity() {
   png_color retval = {0,0xff,0};
-  if (archetype->live()) {
-    int scale = habitants.size() * 0x3;
-    if (scale > 0x1FE) scale = 0x1FE;
-    if (scale < 0xff) {
-      retval.red   = scale;
-      retval.blue  = 0xff;
-      retval.green = 0;
-    } else {
-      scale = 0x1FE - scale;
-      retval.red   = 0xff;
-      retval.blue  = scale;
-      retval.green = 0;
-    }
-  }
+  if (archetype->live()) retval = animalShade(_headcount);
   return retval;
 }
 
+/** The feed is scaled from 0 to 0x1FE of the maximum for the terrain type, rounding up.
+ *  @return The scaled feed, or -1 if the terrain type has no feed.
+ */
+int BioSim::Cell::foodLevel() {
+  double high = archetype->maxfeed();
+  if (!high) return -1;
+  return (int) ceil(0x1FE * (feed / high));
+}
+
 /** 
  *  @return A png_color representing the density of food in the Cell.
  */
 png_color BioSim::Cell::foodDensity() {
   png_color retval = {0,0xff,0};
-  double high = archetype->maxfeed();
-  if (high) {
-    double density = feed/high;
-    int colorPart = (int) ceil(0x1FE * density);
-    if (colorPart < 0xff) {
-      retval.red   = 0xff;
-      retval.blue  = colorPart;
-      retval.green = 0;
-    } else {
-      colorPart = 0x1FE - colorPart;
-      retval.red   = colorPart;
-      retval.blue  = 0xff;
-      retval.green = 0;
-    }
-  }
-
+  int level = foodLevel();
+  if (level >= 0) retval = foodShade(level);
   return retval;
 }
 
 /** This function updates the map by writing color fields to it to represent food and animal densities.
  *
+ *  Only live Cells are drawn, and only those marked dirty since they were last drawn; the colors are looked up in tables made
+ *  by initMapImageBuffer(). The cost thus follows the number of Cells where something happened, rather than the size of the Map.
  */
 void BioSim::Map::updateMapImageBuffer() {
-  std::vector<Cell*>::iterator mapMapIter = _fullAdrMap.begin();
-  while (mapMapIter != _fullAdrMap.end()) {
-    png_color adense = (*mapMapIter)->animalDensity();
-    png_color fdense = (*mapMapIter)->foodDensity();
-    if (adense.green == 0) {
-      int x,y;
-      x = (*mapMapIter)->x_pos();
-      y = (*mapMapIter)->y_pos();
-
-      for (int i = 3; i <=  6; i++) {
-        memcpy(&mapImageBuffer[y*13+3][((x*13+i)*3)],&adense,3);
-      }
-      if (fdense.green == 0) {
-        for (int i = 7; i <= 10; i++) {
-          memcpy(&mapImageBuffer[y*13+3][((x*13+i)*3)],&fdense,3);
-        }
+  for (size_t n = 0; n < _adrMap.size(); n++) {
+    Cell &cell = cells[_adrMap[n]];
+    if (!cell.dirty()) continue;
+    cell.drawn();
+    int x = cell.x_pos();
+    int y = cell.y_pos();
+    png_bytep row = mapImageBuffer[y*13+3];
+    png_color adense = _animalShades[std::min(cell.headcount(), (unsigned int) ANIMAL_SHADES)];
+    for (int i = 3; i <=  6; i++) {
+      memcpy(&row[((x*13+i)*3)],&adense,3);
+    }
+    int level = cell.foodLevel();
+    if (level >= 0) {
+      png_color fdense = (level < (int) _foodShades.size() ? _foodShades[level] : foodShade(level));
+      for (int i = 7; i <= 10; i++) {
+        memcpy(&row[((x*13+i)*3)],&fdense,3);
       }
     }
-    mapMapIter++;
   }
 }
 
 /// This function frees the mapImageBuffer.
 void BioSim::Map::destroyMapImageBuffer() {
+  if (!mapImageBuffer) return; // The Map was never initialized.
   png_uint_32 imageRows = (_rows * 13) + 1; // Each square is 12 pixels tall, separated by 1px black lines.
   for (png_uint_32 i = 1; i < imageRows; i++) {
     if (i % 13 == 1 || i % 13 == 3) {
@@ -632,18 +895,197 @@ void BioSim::Map::destroyMapImageBuffer() {
  *  @return True if the file was successfully closed.
  */
 bool BioSim::Map::writeReport_png(const std::string &fname) {
+  return writeImage(fname, snapshotImage());
+}
+
+/** Only the density rows, the fourth row of each row of squares, ever change; all other rows of the image are drawn once by
+ *  initMapImageBuffer(). The snapshot is a copy of the density rows, one after the other.
+ *  @return The density rows of the current map image.
+ */
+std::vector<png_byte> BioSim::Map::snapshotImage() {
   updateMapImageBuffer();
+  png_size_t colBytes = ((_cols * 13) + 1) * 3;
+  std::vector<png_byte> snapshot(_rows * colBytes);
+  for (unsigned int y = 0; y < _rows; y++) {
+    memcpy(&snapshot[y * colBytes], mapImageBuffer[y * 13 + 3], colBytes);
+  }
+  return snapshot;
+}
+
+/** @param name @c rask, @c balansert or @c arkiv.
+ *  @return The profile.
+ */
+BioSim::PngProfile BioSim::pngProfile(const std::string &name) {
+  if (name == "rask") return PNG_FAST;
+  if (name == "balansert") return PNG_BALANCED;
+  if (name == "arkiv") return PNG_ARCHIVAL;
+  throw std::runtime_error("Unknown PNG profile: " + name);
+}
+
+/// The zlib compression level of each PngProfile.
+static const int pngLevel[] = {Z_BEST_SPEED, 6, Z_BEST_COMPRESSION};
+
+/** @param p     Where to store the number.
+ *  @param value The number, stored in network byte order as PNG and zlib want.
+ */
+static void putBigEndian(unsigned char *p, uLong value) {
+  p[0] = (value >> 24) & 0xff;
+  p[1] = (value >> 16) & 0xff;
+  p[2] = (value >> 8) & 0xff;
+  p[3] = value & 0xff;
+}
+
+/** @param fp     The file to write to.
+ *  @param type   The four letter type of the chunk.
+ *  @param data   The contents of the chunk.
+ *  @param length The length of the contents.
+ */
+static void pngChunk(FILE *fp, const char *type, const unsigned char *data, size_t length) {
+  unsigned char head[8];
+  putBigEndian(head, length);
+  memcpy(head + 4, type, 4);
+  uLong crc = crc32(crc32(0L, Z_NULL, 0), head + 4, 4);
+  if (length) crc = crc32(crc, data, length);
+  unsigned char tail[4];
+  putBigEndian(tail, crc);
+  fwrite(head, 1, 8, fp);
+  if (length) fwrite(data, 1, length, fp);
+  fwrite(tail, 1, 4, fp);
+}
+
+/// @brief A horizontal strip of a PNG image, deflated on its own.
+struct PngStrip {
+  std::vector<unsigned char> data; ///< @brief The raw deflate data, ending on a byte boundary.
+  uLong adler;                     ///< @brief The Adler-32 checksum of the uncompressed strip.
+  uLong length;                    ///< @brief The length of the uncompressed strip.
+};
+
+/** The strip is deflated as a raw stream, primed with the 32 kB of image data before it, and flushed to a byte boundary; the
+ *  strips of an image may then be deflated independently and joined into one zlib stream, at little cost in size.
+ *  @param rows     The rows of the image.
+ *  @param rowBytes The length of a row, in bytes.
+ *  @param first    The first row of the strip.
+ *  @param last     One past the last row of the strip.
+ *  @param level    The zlib compression level.
+ *  @param strip    The strip to fill in.
+ *  @return True on success.
+ */
+static bool deflateStrip(const std::vector<png_bytep> &rows, png_size_t rowBytes, png_uint_32 first, png_uint_32 last, int level, PngStrip &strip) {
+  png_size_t lineBytes = rowBytes + 1; // Each row starts with its filter type, 0 for none.
+  png_uint_32 back = std::min<png_uint_32>(first, (32768 + lineBytes - 1) / lineBytes);
+  std::vector<unsigned char> raw((last - first + back) * lineBytes);
+  for (png_uint_32 r = first - back; r < last; r++) {
+    unsigned char *line = &raw[(r - first + back) * lineBytes];
+    line[0] = 0;
+    memcpy(line + 1, rows[r], rowBytes);
+  }
+  size_t prefix = back * lineBytes;
+  strip.length = raw.size() - prefix;
+  strip.adler = adler32(adler32(0L, Z_NULL, 0), &raw[prefix], strip.length);
+
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+  if (prefix) {
+    size_t window = std::min<size_t>(prefix, 32768);
+    deflateSetDictionary(&z, &raw[prefix - window], window);
+  }
+  bool final = (last == rows.size());
+  strip.data.resize(deflateBound(&z, strip.length) + 16); // Room for the empty block of the flush.
+  z.next_in = &raw[prefix];
+  z.avail_in = strip.length;
+  z.next_out = &strip.data[0];
+  z.avail_out = strip.data.size();
+  int status = deflate(&z, final ? Z_FINISH : Z_SYNC_FLUSH);
+  bool good = final ? status == Z_STREAM_END : (status == Z_OK && z.avail_in == 0 && z.avail_out != 0);
+  strip.data.resize(strip.data.size() - z.avail_out);
+  deflateEnd(&z);
+  return good;
+}
+
+/** The image is cut into strips of PNG_STRIP rows, which are deflated on up to @c threads threads and written as one IDAT chunk
+ *  each. The strips do not depend on the number of threads, and neither does the file.
+ *  @param fp      The file to write to.
+ *  @param rows    The rows of the image.
+ *  @param width   The width of the image, in pixels.
+ *  @param level   The zlib compression level.
+ *  @param threads The number of threads to use, including the calling thread.
+ *  @return True on success.
+ */
+static bool writeStrips(FILE *fp, const std::vector<png_bytep> &rows, png_uint_32 width, int level, unsigned int threads) {
+  png_uint_32 height = rows.size();
+  size_t count = (height + PNG_STRIP - 1) / PNG_STRIP;
+  std::vector<PngStrip> strips(count);
+  std::atomic<size_t> next(0);
+  std::atomic<bool> good(true);
+  auto work = [&]() {
+    size_t s;
+    while ((s = next.fetch_add(1)) < count) {
+      png_uint_32 first = s * PNG_STRIP;
+      if (!deflateStrip(rows, width * 3, first, std::min<png_uint_32>(first + PNG_STRIP, height), level, strips[s])) good = false;
+    }
+  };
+  std::vector<std::thread> helpers;
+  for (unsigned int i = 1; i < threads && i < count; i++) helpers.push_back(std::thread(work));
+  work();
+  for (size_t i = 0; i < helpers.size(); i++) helpers[i].join();
+  if (!good) return false;
+
+  // The zlib header goes in front of the first strip, and the combined checksum after the last.
+  unsigned char cmf = 0x78; // Deflate, 32 kB window.
+  unsigned char flg = (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+  flg += 31 - ((cmf << 8) + flg) % 31;
+  unsigned char header[2] = {cmf, flg};
+  strips.front().data.insert(strips.front().data.begin(), header, header + 2);
+  uLong adler = adler32(0L, Z_NULL, 0);
+  for (size_t i = 0; i < count; i++) adler = adler32_combine(adler, strips[i].adler, strips[i].length);
+  unsigned char trailer[4];
+  putBigEndian(trailer, adler);
+  strips.back().data.insert(strips.back().data.end(), trailer, trailer + 4);
+
+  static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+  unsigned char ihdr[13] = {0};
+  putBigEndian(ihdr, width);
+  putBigEndian(ihdr + 4, height);
+  ihdr[8] = 8;                  // Bit depth.
+  ihdr[9] = PNG_COLOR_TYPE_RGB; // Compression, filter and interlace methods are all 0.
+  fwrite(signature, 1, 8, fp);
+  pngChunk(fp, "IHDR", ihdr, sizeof(ihdr));
+  for (size_t i = 0; i < count; i++) pngChunk(fp, "IDAT", &strips[i].data[0], strips[i].data.size());
+  pngChunk(fp, "IEND", NULL, 0);
+  return !ferror(fp);
+}
+
+/** The unchanging rows are shared with the map image, and only read; this function may therefore run on another thread while
+ *  the Simulation goes on. On one thread, the image is written by libpng; on several, it is cut into strips that are deflated
+ *  in parallel, which gives another, equally valid, file with the same pixels.
+ *  @param fname    The filename to which the report should be written.
+ *  @param snapshot The density rows, as returned by snapshotImage().
+ *  @param profile  How hard to compress the image.
+ *  @param threads  The number of threads to compress the image on.
+ *  @return True if the file was successfully closed.
+ */
+bool BioSim::Map::writeImage(const std::string &fname, const std::vector<png_byte> &snapshot, PngProfile profile, unsigned int threads) const {
   png_uint_32 imageRows = (_rows * 13) + 1; // Each square is 12 pixels tall, separated by 1px black lines.
   png_uint_32 imageCols = (_cols * 13) + 1; // Each square is 12 pixels wide, separated by 1px black lines.
+  png_size_t colBytes = imageCols * 3;
+  std::vector<png_bytep> rows(mapImageBuffer, mapImageBuffer + imageRows);
+  for (png_uint_32 i = 0; i < imageRows; i++) {
+    if (i % 13 >= 3 && i % 13 <= 10) rows[i] = const_cast<png_bytep>(&snapshot[(i / 13) * colBytes]); // The density rows and their copies.
+  }
   FILE *fp = fopen(fname.c_str(), "wb");
   if (!fp) return false;
+  if (threads > 1) {
+    bool good = writeStrips(fp, rows, imageCols, pngLevel[profile], threads);
+    return !fclose(fp) && good;
+  }
   png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
   png_infop  info_ptr = png_create_info_struct(png_ptr);
   png_init_io(png_ptr, fp);
   png_set_filter(png_ptr, PNG_FILTER_TYPE_DEFAULT, PNG_FILTER_NONE);
-  png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
+  png_set_compression_level(png_ptr, pngLevel[profile]);
   png_set_IHDR(png_ptr, info_ptr, imageCols, imageRows, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-  png_set_rows(png_ptr, info_ptr, mapImageBuffer);
+  png_set_rows(png_ptr, info_ptr, &rows[0]);
   png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
   png_destroy_write_struct(&png_ptr, &info_ptr);
   return (!fclose(fp));
@@ -651,16 +1093,18 @@ bool BioSim::Map::writeReport_png(const std::string &fname) {
 
 #endif
 
-/**
+/** This function copies BioSim::Cell::neighbourhood() into a vector.
  *  @return A vector containing pointers to neighbouring cells.
  */
 std::vector<BioSim::Cell*> BioSim::Cell::neighbours() {
-  return _neighbours;
+  return std::vector<BioSim::Cell*>(_neighbours, _neighbours + 4);
 }
 
-/** Sets the neighbouring cells.
+/** Sets the neighbouring cells. Only the first four pointers are used; missing ones are set to @c NULL.
  *  @param newval A vector of Cell pointers for the Cell to consider neighbours.
  */
-void BioSim::Cell::neighbours(std::vector<BioSim::Cell*> newval) {
-  _neighbours = newval;
+void BioSim::Cell::neighbours(const std::vector<BioSim::Cell*> &newval) {
+  for (unsigned int i = 0; i < 4; i++) {
+    _neighbours[i] = (i < newval.size() ? newval[i] : NULL);
+  }
 }
@@ -0,0 +1,336 @@
+/** @file Population.cpp
+ *  @brief This file contains the definitions of the population file formats.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#include "Population.h"
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/// Rounds a length up to a multiple of 8 bytes.
+#define POPULATION_ALIGN(bytes) (((bytes) + 7) & ~(size_t)7)
+
+using BioSim::PopulationMap;
+using BioSim::Population;
+using BioSim::PopulationText;
+
+/** The file is mapped privately and read-only; the kernel is told that it will be read from start to end.
+ *  @param path The pathname of a .bpop file.
+ */
+PopulationMap::PopulationMap(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("PopulationMap: Could not open " + path);
+  struct stat info;
+  if (fstat(fd, &info) || info.st_size < (off_t) sizeof(PopulationHeader)) {
+    close(fd);
+    throw std::runtime_error("PopulationMap: " + path + " is not a .bpop file.");
+  }
+  _size = info.st_size;
+  void *base = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // The mapping keeps the file open.
+  if (base == MAP_FAILED) throw std::runtime_error("PopulationMap: Could not map " + path);
+  madvise(base, _size, MADV_SEQUENTIAL);
+  _base = (char *) base;
+
+  _header = (const PopulationHeader *) _base;
+  size_t genera = POPULATION_ALIGN(sizeof(PopulationHeader) + _header->geography);
+  size_t blocks = genera + (size_t) _header->genera * sizeof(PopulationSpecies);
+  size_t records = blocks + (size_t) _header->blocks * sizeof(PopulationBlock);
+  bool good = !memcmp(_header->magic, POPULATION_MAGIC, 8) && _header->version == POPULATION_VERSION
+    && _header->animals <= (_size - std::min(_size, records)) / sizeof(PopulationRecord)
+    && records + _header->animals * sizeof(PopulationRecord) == _size;
+  if (good) {
+    _genera = (const PopulationSpecies *) (_base + genera);
+    _blocks = (const PopulationBlock *) (_base + blocks);
+    _records = (const PopulationRecord *) (_base + records);
+    for (uint32_t i = 0; good && i < _header->genera; i++) good = memchr(_genera[i].name, 0, POPULATION_NAME) != NULL;
+    for (uint32_t i = 0; good && i < _header->blocks; i++) {
+      const PopulationBlock &block = _blocks[i];
+      good = block.genus < _header->genera && block.first <= _header->animals && block.count <= _header->animals - block.first;
+    }
+  }
+  if (!good) {
+    munmap(_base, _size);
+    throw std::runtime_error("PopulationMap: " + path + " is not a valid .bpop file.");
+  }
+}
+
+PopulationMap::~PopulationMap() {
+  munmap(_base, _size);
+}
+
+/** @param path A pathname.
+ *  @return True if the file can be read and starts with POPULATION_MAGIC.
+ */
+bool PopulationMap::recognize(const std::string &path) {
+  char magic[8];
+  std::ifstream file(path.c_str(), std::ios::binary);
+  return file.read(magic, 8) && !memcmp(magic, POPULATION_MAGIC, 8);
+}
+
+/// @return The name of the geography the population was written for.
+std::string PopulationMap::geography() const {
+  return std::string(_base + sizeof(PopulationHeader), _header->geography);
+}
+
+/** @param p   A position in a text.
+ *  @param end The end of the text.
+ *  @return The start of the next token: whitespace and comments, from the comment character to the end of the line, are skipped.
+ */
+static const char *skipSpace(const char *p, const char *end) {
+  while (p < end) {
+    if (*p == COMMENT_CHAR) {
+      while (p < end && *p != '\n') p++;
+    } else if (isspace((unsigned char) *p)) {
+      p++;
+    } else {
+      break;
+    }
+  }
+  return p;
+}
+
+/** @param p   The start of a token.
+ *  @param end The end of the text.
+ *  @return The end of the token.
+ */
+static const char *skipToken(const char *p, const char *end) {
+  while (p < end && !isspace((unsigned char) *p)) p++;
+  return p;
+}
+
+/** @param p    The start of a number.
+ *  @param stop Where parsing the number stopped.
+ *  @param end  The end of the text.
+ *  @return True if a number was parsed, and it made up a whole token.
+ */
+static bool parsed(const char *p, const char *stop, const char *end) {
+  return p < end && stop != p && stop <= end && (isspace((unsigned char) *stop) || !*stop);
+}
+
+/** @param p   The start of a line.
+ *  @param end The end of the text.
+ *  @return True if the first token of the line is a word rather than a number or a comment; in the Cell block part of a
+ *          .pop file, such a line starts a Cell block.
+ */
+static bool wordLine(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  return p < end && *p != '\n' && *p != COMMENT_CHAR && !isdigit((unsigned char) *p) && !strchr("+-.", *p);
+}
+
+/** The whole file is read with a single read, and the lines before and including the Geografi line are parsed.
+ *  @param path The pathname of a .pop file.
+ */
+PopulationText::PopulationText(const std::string &path) : _path(path) {
+  std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+  if (!file)
+    throw std::runtime_error("PopulationText: Could not open " + path);
+  std::streamoff size = file.tellg();
+  _text.resize(size + 1);
+  file.seekg(0);
+  if (size && !file.read(&_text[0], size))
+    throw std::runtime_error("PopulationText: Could not read " + path);
+  _text[size] = '\0';
+
+  // Parameters come in pairs; the Cell blocks start after the Geografi pair. Without one, there are no Cell blocks.
+  const char *begin = &_text[0];
+  const char *end = begin + size;
+  const char *p = begin;
+  for (;;) {
+    p = skipSpace(p, end);
+    if (p == end) break;
+    const char *param = p;
+    p = skipToken(p, end);
+    std::string key(param, p);
+    p = skipSpace(p, end);
+    const char *value = p;
+    p = skipToken(p, end);
+    if (key == "Geografi") {
+      _geography.assign(value, p);
+      break;
+    }
+  }
+  _chunks.push_back(p - begin);
+  _chunks.push_back(size);
+}
+
+/** Chunks start at lines that start with a word, which in a well-formed file are exactly the lines starting a Cell block.
+ *  @param parts The number of chunks wanted; fewer are made if the file has fewer Cell blocks.
+ */
+void PopulationText::split(size_t parts) {
+  size_t first = _chunks.front();
+  size_t last = _chunks.back();
+  const char *text = &_text[0];
+  _chunks.assign(1, first);
+  for (size_t i = 1; i < parts; i++) {
+    size_t at = std::max(first + (last - first) * i / parts, _chunks.back() + 1);
+    if (at >= last) break;
+    const char *p = text + at;
+    const char *end = text + last;
+    for (;;) {
+      while (p < end && *p != '\n') p++;
+      if (p == end || wordLine(++p, end)) break;
+    }
+    if (p >= end) break;
+    _chunks.push_back(p - text);
+  }
+  _chunks.push_back(last);
+}
+
+/** @param at       Where parsing failed.
+ *  @param expected What was expected there.
+ */
+void PopulationText::fail(const char *at, const char *expected) const {
+  size_t line = std::count(&_text[0], at, '\n') + 1;
+  throw std::runtime_error("PopulationText: " + _path + ", line " + std::to_string(line) + ": expected " + expected);
+}
+
+/** Species are looked up in the species table of @c part once per Cell block. A malformed chunk throws, naming the line.
+ *  @param chunk The number of the chunk.
+ *  @param part  The Population to append to.
+ */
+void PopulationText::parse(size_t chunk, Population &part) const {
+  const char *p = &_text[0] + _chunks[chunk];
+  const char *end = &_text[0] + _chunks[chunk + 1];
+  char *stop;
+  for (;;) {
+    p = skipSpace(p, end);
+    if (p == end) break;
+    const char *name = p;
+    p = skipToken(p, end);
+    PopulationBlock block;
+    block.genus = part.genus(std::string(name, p));
+    block.first = part.records.size();
+    unsigned long number[3];
+    for (int i = 0; i < 3; i++) {
+      p = skipSpace(p, end);
+      number[i] = strtoul(p, &stop, 10);
+      if (!isdigit((unsigned char) *p) || !parsed(p, stop, end)) fail(p, "a number");
+      p = stop;
+    }
+    block.x = number[0];
+    block.y = number[1];
+    block.count = number[2];
+    part.records.reserve(part.records.size() + block.count);
+    for (uint32_t i = 0; i < block.count; i++) {
+      PopulationRecord record;
+      p = skipSpace(p, end);
+      record.alder = strtol(p, &stop, 10);
+      if (!parsed(p, stop, end)) fail(p, "an age");
+      p = skipSpace(stop, end);
+      record.vekt = strtod(p, &stop);
+      if (!parsed(p, stop, end)) fail(p, "a weight");
+      record.reserved = 0;
+      part.records.push_back(record);
+      p = stop;
+    }
+    part.blocks.push_back(block);
+  }
+}
+
+/** @param name The name of a species.
+ *  @return The position of the species in @c genera.
+ */
+unsigned int Population::genus(const std::string &name) {
+  for (unsigned int i = 0; i < genera.size(); i++) {
+    if (genera[i] == name) return i;
+  }
+  genera.push_back(name);
+  return genera.size() - 1;
+}
+
+/** Any previous contents are replaced.
+ *  @param path The pathname of a .pop file.
+ */
+void Population::readText(const std::string &path) {
+  PopulationText text(path);
+  geography = text.geography();
+  genera.clear();
+  blocks.clear();
+  records.clear();
+  text.parse(0, *this);
+}
+
+/** Any previous contents are replaced.
+ *  @param path The pathname of a .bpop file.
+ */
+void Population::readBinary(const std::string &path) {
+  PopulationMap file(path);
+  geography = file.geography();
+  genera.clear();
+  for (unsigned int i = 0; i < file.genera(); i++) genera.push_back(file.genus(i));
+  blocks.assign(file.blocks(), file.blocks() + file.blockCount());
+  records.assign(file.records(), file.records() + file.animals());
+}
+
+/** The layout is that of BioSim::Simulation::writeReport_pop().
+ *  @param path The pathname of the .pop file to write.
+ */
+void Population::writeText(const std::string &path) const {
+  std::ofstream popstream(path.c_str());
+  if (!popstream)
+    throw std::runtime_error("Population::writeText(): Could not open " + path);
+  popstream << COMMENT_CHAR << " populasjon" << std::endl << "Geografi     " << geography << std::endl;
+  popstream.precision(3);
+  for (size_t i = 0; i < blocks.size(); i++) {
+    const PopulationBlock &block = blocks[i];
+    popstream << genera[block.genus] << " " << block.x << " " << block.y << " " << block.count << std::endl;
+    for (uint64_t j = block.first; j < block.first + block.count; j++) {
+      popstream << std::setw(3) << records[j].alder << std::setw(7) << std::fixed << records[j].vekt << std::endl;
+    }
+    popstream << std::endl;
+  }
+  if (!popstream)
+    throw std::runtime_error("Population::writeText(): Could not write " + path);
+}
+
+/** The file is written to a temporary name and renamed into place.
+ *  @param path The pathname of the .bpop file to write.
+ */
+void Population::writeBinary(const std::string &path) const {
+  PopulationHeader header;
+  memcpy(header.magic, POPULATION_MAGIC, 8);
+  header.version = POPULATION_VERSION;
+  header.genera = genera.size();
+  header.blocks = blocks.size();
+  header.geography = geography.size();
+  header.animals = records.size();
+  std::vector<PopulationSpecies> table(genera.size());
+  for (size_t i = 0; i < genera.size(); i++) {
+    if (genera[i].size() >= POPULATION_NAME)
+      throw std::runtime_error("Population::writeBinary(): species name too long: " + genera[i]);
+    memset(table[i].name, 0, POPULATION_NAME);
+    strncpy(table[i].name, genera[i].c_str(), POPULATION_NAME - 1);
+  }
+  std::string padded = geography;
+  padded.resize(POPULATION_ALIGN(sizeof(PopulationHeader) + geography.size()) - sizeof(PopulationHeader), '\0');
+
+  std::string temp = path + ".tmp";
+  std::ofstream out(temp.c_str(), std::ios::binary);
+  if (!out)
+    throw std::runtime_error("Population::writeBinary(): Could not open " + temp);
+  out.write((const char *) &header, sizeof(header));
+  out.write(padded.data(), padded.size());
+  if (!table.empty()) out.write((const char *) &table[0], table.size() * sizeof(PopulationSpecies));
+  if (!blocks.empty()) out.write((const char *) &blocks[0], blocks.size() * sizeof(PopulationBlock));
+  if (!records.empty()) out.write((const char *) &records[0], records.size() * sizeof(PopulationRecord));
+  out.close();
+  if (!out || rename(temp.c_str(), path.c_str())) {
+    remove(temp.c_str());
+    throw std::runtime_error("Population::writeBinary(): Could not write " + path);
+  }
+}
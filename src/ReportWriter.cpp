@@ -0,0 +1,95 @@
+/** @file ReportWriter.cpp
+ *  @brief This file contains the definition of the ReportWriter class.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#include "ReportWriter.h"
+#include <iostream>
+#include <exception>
+
+using BioSim::ReportWriter;
+
+/** @param threads The number of writer threads; with 0, reports are written by submit() itself.
+ *  @param depth   The largest number of reports waiting to be written; at least 1.
+ */
+ReportWriter::ReportWriter(unsigned int threads, size_t depth) : _depth(depth ? depth : 1), _busy(0), _stop(false) {
+  resize(threads);
+}
+
+ReportWriter::~ReportWriter() {
+  stop();
+}
+
+/** The waiting reports are written before the old threads are stopped.
+ *  @param threads The number of writer threads; with 0, reports are written by submit() itself.
+ */
+void ReportWriter::resize(unsigned int threads) {
+  if (threads == _workers.size()) return;
+  stop();
+  _stop = false;
+  for (unsigned int i = 0; i < threads; i++) {
+    _workers.push_back(std::thread(&ReportWriter::work, this));
+  }
+}
+
+void ReportWriter::stop() {
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _stop = true;
+  }
+  _work.notify_all();
+  for (size_t i = 0; i < _workers.size(); i++) _workers[i].join();
+  _workers.clear();
+}
+
+/** @param name The name of the report, used in the warning if it can not be written.
+ *  @param job  The job writing the report. It must not refer to anything the Simulation changes later.
+ */
+void ReportWriter::submit(const std::string &name, const Job &job) {
+  Task task = {name, job};
+  if (_workers.empty()) {
+    write(task);
+    return;
+  }
+  std::unique_lock<std::mutex> guard(_lock);
+  while (_queue.size() >= _depth) _space.wait(guard);
+  _queue.push_back(task);
+  guard.unlock();
+  _work.notify_one();
+}
+
+void ReportWriter::drain() {
+  std::unique_lock<std::mutex> guard(_lock);
+  while (!_queue.empty() || _busy) _space.wait(guard);
+}
+
+void ReportWriter::work() {
+  std::unique_lock<std::mutex> guard(_lock);
+  for (;;) {
+    while (!_stop && _queue.empty()) _work.wait(guard);
+    if (_queue.empty()) return;
+    Task task = _queue.front();
+    _queue.pop_front();
+    _busy++;
+    guard.unlock();
+    _space.notify_all();
+    write(task);
+    guard.lock();
+    _busy--;
+    _space.notify_all();
+  }
+}
+
+/// @param task The report to write.
+void ReportWriter::write(const Task &task) {
+  bool good = false;
+  try {
+    good = task.job();
+  } catch (std::exception &e) {
+    std::cerr << "Warning: " << e.what() << std::endl;
+  }
+  if (!good) std::cerr << "Warning: could not write " << task.name << std::endl;
+}
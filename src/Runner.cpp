@@ -0,0 +1,75 @@
+/** @file Runner.cpp
+ *  @brief This file contains the definition of runForked().
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#include "Runner.h"
+#include <iostream>
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/** Each job runs in a forked process, with its standard output and error sent to an anonymous temporary file. When it ends, the
+ *  file is copied to standard output under the label of the job. The jobs share nothing but the files they are told to write.
+ *  @param labels The label of each job; there is one job per label.
+ *  @param jobs   The largest number of jobs to run at once.
+ *  @param job    Called in the forked process with the number of the job; returns its exit code.
+ */
+int BioSim::runForked(const std::vector<std::string> &labels, unsigned int jobs, const std::function<int (size_t)> &job) {
+  std::map<pid_t, std::pair<size_t, FILE *> > running; // Job number and console output of each worker.
+  int retval = EXIT_SUCCESS;
+  size_t next = 0;
+  while (next < labels.size() || !running.empty()) {
+    while (running.size() < jobs && next < labels.size()) {
+      size_t number = next++;
+      FILE *console = tmpfile();
+      std::cout.flush();
+      fflush(NULL); // Nothing buffered may be written twice.
+      pid_t pid = console ? fork() : -1;
+      if (pid == 0) {
+        dup2(fileno(console), STDOUT_FILENO);
+        dup2(fileno(console), STDERR_FILENO);
+        int code = job(number);
+        std::cout.flush();
+        std::cerr.flush();
+        _exit(code);
+      }
+      if (pid < 0) {
+        std::cerr << "Error in " << labels[number] << ": could not start a worker." << std::endl;
+        if (console) fclose(console);
+        retval += EXIT_FAILURE;
+        continue;
+      }
+      running[pid] = std::make_pair(number, console);
+    }
+    if (running.empty()) break;
+
+    int status;
+    pid_t pid = wait(&status);
+    if (pid < 0) break;
+    std::map<pid_t, std::pair<size_t, FILE *> >::iterator done = running.find(pid);
+    if (done == running.end()) continue;
+    const std::string &label = labels[done->second.first];
+    std::cout << label << ":" << std::endl;
+    FILE *console = done->second.second;
+    rewind(console);
+    char buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), console)) > 0) std::cout.write(buffer, length);
+    fclose(console);
+    std::cout << std::endl;
+    if (WIFEXITED(status)) {
+      retval += WEXITSTATUS(status);
+    } else {
+      std::cerr << "Error in " << label << ": worker killed by signal " << WTERMSIG(status) << std::endl;
+      retval += EXIT_FAILURE;
+    }
+    running.erase(done);
+  }
+  return retval;
+}
@@ -0,0 +1,207 @@
+/** @file Sweep.cpp
+ *  @brief This file contains the definition of the Sweep class.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#include "Sweep.h"
+#include "Runner.h"
+#include "BioSim.h"
+#include "skip_comment.h"
+#include "filename.h"
+#include "random.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+
+using BioSim::Sweep;
+
+Sweep::Sweep() : _method("rutenett"), _samples(0), _seed(0) {
+}
+
+/** The description names the .sim file, the filename base of the output, the sampling method and the swept parameters:
+ *  @code
+ *  Simulering    data/bjarnoya.sim
+ *  Utdata        data/sveip
+ *  Metode        latinsk
+ *  Prover        16
+ *  SlumptallFroe 7
+ *  Parameter     B         mu    0.1 0.5
+ *  Parameter     Celle J   alpha 0.2 0.8
+ *  @endcode
+ *  @param description The pathname of the sweep description.
+ */
+void Sweep::init(const std::string &description) {
+  std::ifstream is(description.c_str());
+  if (!is) throw std::runtime_error("Sweep::init(): could not open " + description);
+  _axes.clear();
+  for (toolbox::skip_comment(is, COMMENT_CHAR); is; toolbox::skip_comment(is, COMMENT_CHAR)) {
+    std::string line;
+    if (!std::getline(is, line)) break;
+    std::istringstream words(line);
+    std::string key;
+    words >> key;
+    if (key == "Simulering") {
+      words >> _simulation;
+    } else if (key == "Utdata") {
+      words >> _output;
+    } else if (key == "Metode") {
+      words >> _method;
+    } else if (key == "Prover") {
+      words >> _samples;
+    } else if (key == "SlumptallFroe") {
+      words >> _seed;
+    } else if (key == "Parameter") {
+      Axis axis;
+      words >> axis.target;
+      axis.terrain = axis.target == "Celle";
+      if (axis.terrain) words >> axis.target;
+      words >> axis.param >> axis.low >> axis.high;
+      if (words.fail() || (axis.terrain && axis.target.size() != 1))
+        throw std::runtime_error("Sweep::init(): malformed parameter in " + description + ": " + line);
+      if (!(words >> axis.steps)) axis.steps = 2;
+      _axes.push_back(axis);
+      continue;
+    } else {
+      throw std::runtime_error("Sweep::init(): unknown keyword " + key + " in " + description);
+    }
+    if (words.fail()) throw std::runtime_error("Sweep::init(): malformed line in " + description + ": " + line);
+  }
+  if (_simulation.empty() || _output.empty())
+    throw std::runtime_error("Sweep::init(): " + description + " lacks Simulering or Utdata");
+  if (_axes.empty()) throw std::runtime_error("Sweep::init(): " + description + " has no Parameter");
+  sample();
+  if (_points.empty()) throw std::runtime_error("Sweep::init(): " + description + " has no points to run");
+}
+
+/** With @c rutenett, every combination of @c steps evenly spaced values of each axis is run, the last axis varying fastest.
+ *  With @c tilfeldig, @c Prover points are drawn uniformly from the box spanned by the axes. With @c latinsk, the range of each
+ *  axis is cut into @c Prover strata, and every stratum of every axis is sampled exactly once, at a random place within it.
+ *  The random numbers depend on @c SlumptallFroe and the axis only, so adding an axis leaves the values of the others alone.
+ */
+void Sweep::sample() {
+  _points.clear();
+  if (_method == "rutenett") {
+    size_t count = 1;
+    for (size_t a = 0; a < _axes.size(); a++) count *= _axes[a].steps;
+    _points.assign(count, std::vector<double>(_axes.size()));
+    for (size_t run = 0; run < count; run++) {
+      size_t rest = run;
+      for (size_t a = _axes.size(); a-- > 0; ) {
+        const Axis &axis = _axes[a];
+        size_t k = rest % axis.steps;
+        rest /= axis.steps;
+        _points[run][a] = axis.steps > 1 ? axis.low + k * (axis.high - axis.low) / (axis.steps - 1) : axis.low;
+      }
+    }
+  } else if (_method == "tilfeldig" || _method == "latinsk") {
+    bool latin = _method == "latinsk";
+    _points.assign(_samples, std::vector<double>(_axes.size()));
+    for (size_t a = 0; a < _axes.size(); a++) {
+      const Axis &axis = _axes[a];
+      toolbox::RandomStream rng(_seed, 0, latin, a);
+      std::vector<unsigned int> strata(_samples);
+      for (unsigned int i = 0; i < _samples; i++) strata[i] = i;
+      if (latin) {
+        for (unsigned int i = _samples; i > 1; i--) std::swap(strata[i - 1], strata[rng.nrand(i)]);
+      }
+      for (unsigned int run = 0; run < _samples; run++) {
+        double u = latin ? (strata[run] + rng.drand()) / _samples : rng.drand();
+        _points[run][a] = axis.low + u * (axis.high - axis.low);
+      }
+    }
+  } else {
+    throw std::runtime_error("Sweep::sample(): unknown method " + _method);
+  }
+}
+
+/** @param run The number of the run.
+ *  @return @c Utdata.NNNN, under which the run writes its reports.
+ */
+std::string Sweep::stem(size_t run) {
+  return toolbox::Filename(_output).num_name(run, 4);
+}
+
+/** The Simulation is initialized here, before the runs are forked, so that they share its Map and populations. Unknown Species,
+ *  terrain types or parameters are found at once, by applying the values of the first run to the shared Simulation.
+ *  @param jobs    The largest number of runs at once.
+ *  @param threads The number of threads of each run, or 0 to use @c Traader.
+ *  @return The number of runs that failed, times EXIT_FAILURE, as for several .sim files.
+ */
+int Sweep::run(unsigned int jobs, int threads) {
+  Simulation core;
+  core.threadCount(threads);
+  core.init(_simulation);
+  for (size_t a = 0; a < _axes.size(); a++) {
+    if (_axes[a].terrain)
+      core.adjustTerrain(_axes[a].target[0], _axes[a].param, _points[0][a]);
+    else
+      core.adjustSpecies(_axes[a].target, _axes[a].param, _points[0][a]);
+  }
+  core.suspend();
+
+  std::vector<std::string> labels;
+  for (size_t run = 0; run < _points.size(); run++) labels.push_back(stem(run));
+  int retval = runForked(labels, jobs, [&](size_t run) -> int {
+    try {
+      for (size_t a = 0; a < _axes.size(); a++) {
+        if (_axes[a].terrain)
+          core.adjustTerrain(_axes[a].target[0], _axes[a].param, _points[run][a]);
+        else
+          core.adjustSpecies(_axes[a].target, _axes[a].param, _points[run][a]);
+      }
+      core.redirect(labels[run]);
+      return core.run();
+    } catch (std::runtime_error &e) {
+      std::cerr << "Error in " << labels[run] << ": " << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  });
+  if (!gather()) {
+    std::cerr << "Warning: could not write " << _output << ".tab" << std::endl;
+    retval += EXIT_FAILURE;
+  }
+  return retval;
+}
+
+/** Each row holds the number of the run, its parameter values and a row of its .dat report. A run whose report is missing is
+ *  left out.
+ *  @return True if the table was written.
+ */
+bool Sweep::gather() {
+  std::ofstream table((_output + ".tab").c_str());
+  table << COMMENT_CHAR << " Simulering " << _simulation << ", Metode " << _method << ", " << _points.size() << " kjoringer" << std::endl;
+  std::vector<int> widths; // Room for the name and a space, and for the values.
+  for (size_t a = 0; a < _axes.size(); a++)
+    widths.push_back(std::max<size_t>(14, _axes[a].target.size() + _axes[a].param.size() + 2));
+  std::string columns;
+  for (size_t run = 0; run < _points.size(); run++) {
+    std::ifstream dat((stem(run) + ".dat").c_str());
+    std::string line;
+    while (std::getline(dat, line)) {
+      std::istringstream words(line);
+      std::string first;
+      if (!(words >> first)) continue;
+      if (first == std::string(1, COMMENT_CHAR) + "Year") {
+        if (!columns.empty()) continue;
+        columns = line.substr(line.find(first) + first.size());
+        table << COMMENT_CHAR << " Run";
+        for (size_t a = 0; a < _axes.size(); a++)
+          table << std::setw(widths[a]) << _axes[a].target + "." + _axes[a].param;
+        table << std::setw(5) << "Year" << columns << std::endl;
+        continue;
+      }
+      char *end;
+      long year = strtol(first.c_str(), &end, 10);
+      if (*end) continue; // Neither a year nor a heading.
+      table << std::setw(5) << run;
+      for (size_t a = 0; a < _axes.size(); a++) table << std::setw(widths[a]) << std::setprecision(8) << _points[run][a];
+      table << std::setw(5) << year << line.substr(line.find(first) + first.size()) << std::endl;
+    }
+  }
+  return table.good();
+}
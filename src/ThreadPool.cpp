@@ -0,0 +1,99 @@
+/** @file ThreadPool.cpp
+ *  @brief This file contains the definition of the ThreadPool class.
+ *  @author Williham Totland
+ *  @version 1.0
+ *  @date 15.10.26
+ *  @ingroup BioSim
+ */
+
+#include "ThreadPool.h"
+
+using BioSim::ThreadPool;
+
+/// @param threads The number of threads, including the calling thread; 0 counts as 1.
+ThreadPool::ThreadPool(unsigned int threads) : _job(NULL), _tasks(0), _next(0), _busy(0), _generation(0), _stop(false) {
+  resize(threads);
+}
+
+ThreadPool::~ThreadPool() {
+  stop();
+}
+
+/** Any workers are stopped and a new set is started. Must not be called while a job is running.
+ *  @param threads The number of threads, including the calling thread; 0 counts as 1.
+ */
+void ThreadPool::resize(unsigned int threads) {
+  if (threads == 0) threads = 1;
+  if (threads == size()) return;
+  stop();
+  _stop = false;
+  for (unsigned int i = 1; i < threads; i++) {
+    _workers.push_back(std::thread(&ThreadPool::work, this, i, _generation));
+  }
+}
+
+void ThreadPool::stop() {
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (size_t i = 0; i < _workers.size(); i++) _workers[i].join();
+  _workers.clear();
+}
+
+/** With a single thread, or a single task, the job runs directly on the calling thread.
+ *  If tasks throw, the remaining tasks are still run, and the first exception is rethrown here.
+ *  @param tasks The number of tasks.
+ *  @param job   The job to call for each task.
+ */
+void ThreadPool::run(size_t tasks, const Job &job) {
+  if (_workers.empty() || tasks <= 1) {
+    for (size_t i = 0; i < tasks; i++) job(i, 0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _job = &job;
+    _tasks = tasks;
+    _next = 0;
+    _busy = _workers.size();
+    _error = std::exception_ptr();
+    _generation++;
+  }
+  _wake.notify_all();
+  drain(0);
+  std::unique_lock<std::mutex> guard(_lock);
+  while (_busy) _done.wait(guard);
+  _job = NULL;
+  if (_error) std::rethrow_exception(_error);
+}
+
+/// @param thread The number of the calling thread.
+void ThreadPool::drain(unsigned int thread) {
+  size_t task;
+  while ((task = _next.fetch_add(1)) < _tasks) {
+    try {
+      (*_job)(task, thread);
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(_lock);
+      if (!_error) _error = std::current_exception();
+    }
+  }
+}
+
+/** @param thread The number of the worker thread, from 1.
+ *  @param seen   The last job generation before the thread was started; a job started before the thread gets to run is not missed.
+ */
+void ThreadPool::work(unsigned int thread, unsigned long seen) {
+  std::unique_lock<std::mutex> guard(_lock);
+  for (;;) {
+    while (!_stop && _generation == seen) _wake.wait(guard);
+    if (_stop) return;
+    seen = _generation;
+    guard.unlock();
+    drain(thread);
+    guard.lock();
+    if (--_busy == 0) _done.notify_one();
+  }
+}
@@ -3,8 +3,11 @@
 #include <iomanip>
 #include "random.h"
 #include "BioSim.h"
+#include "Runner.h"
+#include "Sweep.h"
 #include <vector>
 #include <string>
+#include <cstdlib>
 
 /** @mainpage
  *
@@ -17,12 +20,37 @@
  *  @endcode
  *  This will install BioSim in /usr/bin/BioSim and the BioSim documentation in HTML format in /usr/share/doc/BioSim/. Building the program requires @c libpng and development files, available through package @c libpng-dev.
  *  @see prefix.h
+ *
+ *  To time the Simulation core, execute:
+ *  @code
+ *  # make bench BENCH_FLAGS="-t threads -y years -s scale" BENCH_OUT=results.json
+ *  @endcode
+ *  This builds BioSimBench from bench/bench.cpp and writes its results as JSON to @c BENCH_OUT, by default bench.json, which
+ *  git ignores. It times the fitness function, the random generator, Cell and Map lookups, the population readers and
+ *  writers and the PNG encoders, and whole years of the test_1 example, tiled up to @c scale times in each direction, in
+ *  animal-updates per second. The flags are optional. BioSimBench and the objects it links are compiled apart, under obj/opt,
+ *  with @c OPT, by default -O2; the compiler flags are recorded in the JSON next to the compiler version.
  *  @section usage_sec Usage
  *  Synopsis:
  *  @code
- *  # BioSim filename [filename...]
+ *  # BioSim [-t threads] [-j jobs] filename [filename...]
+ *  # BioSim [-t threads] --resume checkpoint filename
+ *  # BioSim [-t threads] [-j jobs] --sweep description
+ *  # BioSim --pop2bin population.pop population.bpop
+ *  # BioSim --bin2pop population.bpop population.pop
  *  @endcode
  *  Any number of filenames may be entered on the command line. Where several filenames are entered, the simulations will be run in the order they are specified.
+ *  With @c -t, every simulation uses the given number of threads, regardless of @c Traader in its .sim file.
+ *  With @c -j, up to the given number of simulations run at once, each in a process of its own. The console output of each
+ *  simulation is held back until it ends, and then printed as a whole, under its filename, so that the output of simulations
+ *  finishing in any order is not mixed. The exit status counts the simulations that failed, as when they are run in order.
+ *  With @c --resume, a single simulation continues from a checkpoint written with @c DumpChkInterval, exactly as it would have
+ *  continued when the checkpoint was written. The .sim file must be the one the checkpoint was written with; the .dat report is
+ *  cut back to the checkpoint year and continued. The Animals are taken from the checkpoint, so its @c Populasjon files are not read.
+ *  With @c --sweep, one simulation is run many times over a range of parameters; see @ref sweep_file. With @c -j, up to the given
+ *  number of runs run at once.
+ *  With @c --pop2bin and @c --bin2pop, a population file is converted between the text .pop format and the binary .bpop format, and
+ *  no simulation is run.
  *  @section infile_formats Input File Formats
  *  @subsection sim_file .sim File
  *  The .sim file contains simulation parameters.
@@ -37,6 +65,23 @@
  *      - @c DumpPNGInterval
  *      - @c CelleSpec
  *      - @c ArtParameter
+ *      - @c StoreSider: If @c 1, Animal data is kept in huge pages where the system provides them. Defaults to @c 0.
+ *      - @c Traader: The number of threads used to step the simulation. Results do not depend on this number. Defaults to @c 1.
+ *        Since the Cells feed in parallel, predation draws from a random stream of each Cell rather than from one stream in the
+ *        order of a global sort by fitness. For a given seed the results therefore differ from those of the original serial
+ *        engine, though they are the same for any number of threads.
+ *      - @c FitnessToleranse: If above @c 0, the weight factors of the fitness function are interpolated from a table, with at most this error. Defaults to @c 0, exact fitness.
+ *      - @c FitnessKontroll: If @c 1, the largest error of the fitness tables of each species is printed at start-up. Defaults to @c 0.
+ *      - @c DumpChkInterval: The interval for checkpoints, @c UtdataStamme.NNNNN.chk, from which the simulation can be resumed. Defaults to @c 0, none.
+ *      - @c KomprimerChk: If @c 1, checkpoints are gzip compressed. Defaults to @c 0.
+ *      - @c SortertJakt: If @c 1, predators hunt the herbivores of their Cell from the least fit, and stop at the first one at least as fit as
+ *        themselves; see BioSim::Species::hunt(). Since no random numbers are drawn for hopeless attempts, this changes the random streams,
+ *        and so the results, compared to the default mode @c 0, in which every cellmate of another species is tried.
+ *      - @c RapportTraader: The number of threads writing the .dyr, .for, .pop and .png reports, while the simulation goes on with the
+ *        next year. Defaults to @c 1; with @c 0, reports are written between years.
+ *      - @c PNGProfil: How hard .png reports are compressed: @c rask, @c balansert or @c arkiv. Defaults to @c arkiv, the smallest files.
+ *      - @c PNGTraader: The number of threads compressing each .png report. With more than @c 1, the image is compressed in strips,
+ *        which gives slightly larger files, though with the same pixels, whatever the number. Defaults to @c 1.
  *    - While they are formally optional, a .sim file must have:
  *      - At least one @c ArtParameter, @c RovdyrParameter or @c BytteParameter. A file can have any number of @c ArtParameter, but only one each of @c RovdyrParameter and @c BytteParameter.
  *      - @b Either a @c CelleSpec @b or a @c CelleParameter.
@@ -64,11 +109,34 @@
  *  @subsection geo_file .geo File
  *  The .geo file contains map data for the simulation.
  *  @subsection pop_file .pop File
- *  The .pop files contains data for presimulated populations to use in the simulation.
+ *  The .pop files contains data for presimulated populations to use in the simulation. A comment may start wherever a word or
+ *  number may. All files named by @c Populasjon are read at once, and large files are parsed in parallel.
+ *  @subsection bpop_file .bpop File
+ *  A binary population file, for fast start-up with large populations. It may be given to @c Populasjon instead of a .pop file, and
+ *  is told apart by its contents. It is mapped into memory and its Animals inserted in bulk. The layout is described in
+ *  BioSim::PopulationHeader; the numbers are in the byte order of the machine that wrote it. Use @c --pop2bin and @c --bin2pop to
+ *  convert.
+ *  @subsection sweep_file Sweep Description
+ *  A sweep description, given to @c --sweep, names a .sim file and the Species or terrain type parameters to vary:
+ *  @code
+ *  Simulering    test_1/test_1.sim
+ *  Utdata        data/sveip
+ *  Metode        rutenett
+ *  Parameter     B         mu    0.1 0.5 3
+ *  Parameter     Celle J   alpha 0.2 0.8 2
+ *  @endcode
+ *  A Species is named as in its .par file, and its parameters by their .par keywords. A terrain type is named by @c Celle and its
+ *  letter; its parameters are @c alpha and @c fmax. Each @c Parameter gives the smallest and largest value, and, for @c Metode
+ *  @c rutenett, the number of evenly spaced values, 2 if left out; every combination is run. With @c Metode @c tilfeldig,
+ *  @c Prover points are drawn at random within the ranges, and with @c latinsk, they form a Latin hypercube sample. The draws
+ *  depend on @c SlumptallFroe in the description. The Map and populations are read once and shared by all runs; each run writes
+ *  the reports of its .sim file under @c Utdata.NNNN, and the .dat reports of all runs are gathered in @c Utdata.tab, one row per
+ *  run and year, headed by the number of the run and its parameter values.
  *  @note This version of BioSim uses '#' (hash) as the default comment character in all files, and not '%%'. This allows for the #! construct.
  *  @section outfile_formats Output File Formats
  *  @subsection dat_files .dat Files
- *  The .dat file is the principal output format.
+ *  The .dat file is the principal output format. Each year has a row with the number of herbivores (B) and predators (R) on the
+ *  terrain types J, S and O, followed by any other live terrain type of the cell specification, in order of name.
  *  @subsection for_files .for Files
  *  The .for files contain information about feed distribution over the Simulation map.
  *  @subsection pop_files .pop Files
@@ -84,39 +152,106 @@
  *  @date 25.02.08
  */
 
+/** @param filename   The .sim file.
+ *  @param threads    The number of threads, or 0 to use @c Traader.
+ *  @param checkpoint A checkpoint to resume from, or empty.
+ *  @return EXIT_SUCCESS, or EXIT_FAILURE if the simulation failed.
+ */
+static int runSimulation(const std::string &filename, int threads, const std::string &checkpoint) {
+  BioSim::Simulation core;
+  core.threadCount(threads);
+  if (!checkpoint.empty()) core.resume(checkpoint);
+  try {
+    core.init(filename);
+    return core.run();
+  }
+  /** Runtime error exeptions in the simulations not caught and corrected for will be caught here.
+   *  This will result in an error message being printed to stderr, and the total exit code will be increase by EXIT_FAILURE.
+   */
+  catch ( std::runtime_error &e ) {
+    std::cerr << "Error in "<< filename << ": " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
+
 /** @brief Initializes and runs the application.
  *
  *  This function is responsible for reading command line arguments and creating BioSim::Simulation instances.
  */
 int main (int argc, char * const argv[]) {
   std::vector<std::string> filenames;
-  if (argc > 1) {
-    for (int i = 1; i != argc; i++) {
-      filenames.push_back(std::string(argv[i]));
+  if (argc == 4 && (std::string(argv[1]) == "--pop2bin" || std::string(argv[1]) == "--bin2pop")) {
+    BioSim::Population population;
+    try {
+      if (std::string(argv[1]) == "--pop2bin") {
+        population.readText(argv[2]);
+        population.writeBinary(argv[3]);
+      } else {
+        population.readBinary(argv[2]);
+        population.writeText(argv[3]);
+      }
+    } catch ( std::runtime_error &e ) {
+      std::cerr << "Error in " << argv[2] << ": " << e.what() << std::endl;
+      return EXIT_FAILURE;
     }
+    return EXIT_SUCCESS;
   }
 
-  if (filenames.size() == 0) {
-    std::cout << "Usage: BioSim filename [filename...]" << std::endl;
+  int threads = 0;
+  int jobs = 1;
+  std::string checkpoint;
+  std::string sweep;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--resume" && i + 1 < argc) {
+      checkpoint = argv[++i];
+    } else if (arg == "--sweep" && i + 1 < argc) {
+      sweep = argv[++i];
+    } else if (arg == "-t" && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+      if (threads < 1) {
+        filenames.clear(); // Prints the usage below.
+        break;
+      }
+    } else if (arg == "-j" && i + 1 < argc) {
+      jobs = atoi(argv[++i]);
+      if (jobs < 1) {
+        filenames.clear(); // Prints the usage below.
+        break;
+      }
+    } else {
+      filenames.push_back(arg);
+    }
+  }
+
+  if (!sweep.empty() && filenames.empty() && checkpoint.empty()) {
+    BioSim::Sweep sweeper;
+    try {
+      sweeper.init(sweep);
+      return sweeper.run(jobs, threads);
+    } catch ( std::runtime_error &e ) {
+      std::cerr << "Error in " << sweep << ": " << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (filenames.size() == 0 || (!checkpoint.empty() && filenames.size() != 1)) {
+    std::cout << "Usage: BioSim [-t threads] [-j jobs] filename [filename...]" << std::endl;
+    std::cout << "       BioSim [-t threads] --resume checkpoint filename" << std::endl;
+    std::cout << "       BioSim [-t threads] [-j jobs] --sweep description" << std::endl;
+    std::cout << "       BioSim --pop2bin|--bin2pop infile outfile" << std::endl;
     exit(EXIT_FAILURE);
   }
 
+  if (jobs > 1 && filenames.size() > 1) {
+    return BioSim::runForked(filenames, jobs, [&](size_t i) { return runSimulation(filenames[i], threads, ""); });
+  }
+
   int retval = EXIT_SUCCESS; // exit code
   std::vector<std::string>::iterator iter = filenames.begin();
   while (iter != filenames.end()) {
     if (filenames.size() > 1) std::cout << (*iter) << ":"<< std::endl;
-    BioSim::Simulation core;
-    try {
-      core.init(*iter);
-      retval += core.run();
-    }
-    /** Runtime error exeptions in the simulations not caught and corrected for will be caught here.
-     *  This will result in an error message being printed to stderr, and the total exit code will be increase by EXIT_FAILURE.
-     */
-    catch ( std::runtime_error &e ) {
-      std::cerr << "Error in "<< (*iter) << ": " << e.what() << std::endl;
-      retval += EXIT_FAILURE;
-    }
+    retval += runSimulation(*iter, threads, checkpoint);
     iter++;
   }
   return retval;
@@ -1,33 +1,165 @@
 #include "random.h"
-#include <cstdlib>
-#include <stdexcept>
+#include <istream>
+#include <ostream>
 
-toolbox::RandomGenerator::RandomGenerator(unsigned int seed)
+// Philox4x32 constants, see Salmon et al.
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+// counters per block in the bulk RandomGenerator::drand()
+#define PHILOX_LANES 8
+
+void toolbox::philox(uint32_t ctr[4], const uint32_t key[2])
+{
+  uint32_t k0 = key[0];
+  uint32_t k1 = key[1];
+
+  for ( int round = 0 ; round < 10 ; ++round )
+  {
+    const uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * ctr[0];
+    const uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * ctr[2];
+    const uint32_t c1 = ctr[1];
+    const uint32_t c3 = ctr[3];
+    ctr[0] = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+    ctr[1] = static_cast<uint32_t>(p1);
+    ctr[2] = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+    ctr[3] = static_cast<uint32_t>(p0);
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+}
+
+toolbox::RandomStream::RandomStream()
 {
-  if ( seed > RAND_MAX )
-    throw std::domain_error("toolbox::RandomGenerator::RandomGenerator(): Argument is out of range.");
+  key_[0] = key_[1] = 0;
+  ctr_[0] = ctr_[1] = ctr_[2] = ctr_[3] = 0;
+  buf_[0] = buf_[1] = buf_[2] = buf_[3] = 0;
+  used_ = 4;
+}
 
-  srand(seed);
+toolbox::RandomStream::RandomStream(uint64_t seed, uint32_t year, uint32_t phase, uint32_t entity)
+{
+  key_[0] = static_cast<uint32_t>(seed);
+  key_[1] = static_cast<uint32_t>(seed >> 32);
+  ctr_[0] = 0;
+  ctr_[1] = entity;
+  ctr_[2] = year;
+  ctr_[3] = phase;
+  buf_[0] = buf_[1] = buf_[2] = buf_[3] = 0;
+  used_ = 4;
 }
 
-toolbox::RandomGenerator& toolbox::randomGen(unsigned int seed)
+uint64_t toolbox::RandomStream::draws() const
 {
-  static bool seeded = false;
+  return static_cast<uint64_t>(ctr_[0]) * 4 - (used_ == 4 ? 0 : 4 - used_);
+}
 
-  // ensure rng is seeded on first call
-  if ( !seeded && seed == 0 )
-    throw std::logic_error("toolbox::randomGen(): rng must be seeded on first call.");
+std::ostream& toolbox::RandomStream::write(std::ostream &os) const
+{
+  // the current block is recomputed on reading, so only the address is stored
+  const uint64_t n = draws();
+  os.write(reinterpret_cast<const char*>(key_), sizeof(key_));
+  os.write(reinterpret_cast<const char*>(ctr_ + 1), 3 * sizeof(uint32_t));
+  os.write(reinterpret_cast<const char*>(&n), sizeof(n));
+  return os;
+}
 
-  // the one and only RandomGenerator instance
-  // is constructed first time we pass here
-  static RandomGenerator rng(seed);  
+std::istream& toolbox::RandomStream::read(std::istream &is)
+{
+  uint64_t n = 0;
+  is.read(reinterpret_cast<char*>(key_), sizeof(key_));
+  is.read(reinterpret_cast<char*>(ctr_ + 1), 3 * sizeof(uint32_t));
+  is.read(reinterpret_cast<char*>(&n), sizeof(n));
+  ctr_[0] = static_cast<uint32_t>(n / 4);
+  used_ = 4;
+  for ( uint64_t skip = n % 4 ; skip > 0 ; --skip )
+    next();
+  return is;
+}
 
-  // ensure function was called without argument later
-  // NOTE: we set seeded only at end, so on first call, this will not throw
-  if ( seeded && seed != 0 )
-    throw std::logic_error("toolbox::randomGen(): rng must be seeded on first call ONLY.");
-  
-  seeded = true;
+toolbox::RandomGenerator::RandomGenerator(uint64_t seed)
+  : seed_(seed), year_(0)
+{
+}
 
-  return rng;
+void toolbox::RandomGenerator::seed(uint64_t seed)
+{
+  seed_ = seed;
+}
+
+toolbox::RandomStream toolbox::RandomGenerator::stream(uint32_t phase, uint32_t entity) const
+{
+  return RandomStream(seed_, year_, phase, entity);
+}
+
+double toolbox::RandomGenerator::drand(uint32_t phase, uint32_t entity, uint32_t draw) const
+{
+  // each drand() takes two words, so draw d is words 2d and 2d + 1
+  uint32_t key[2] = { static_cast<uint32_t>(seed_), static_cast<uint32_t>(seed_ >> 32) };
+  uint32_t ctr[4] = { draw / 2, entity, year_, phase };
+  philox(ctr, key);
+  const unsigned int w = 2 * (draw % 2);
+  const uint64_t hi = ctr[w] >> 5;
+  const uint64_t lo = ctr[w + 1] >> 6;
+  return ((hi << 26) | lo) * (1.0 / 9007199254740992.0);
+}
+
+void toolbox::RandomGenerator::drand(uint32_t phase, const uint32_t *entities, size_t n, uint32_t draw, double *u) const
+{
+  // the rounds run over PHILOX_LANES counters side by side, which the compiler can keep in vector registers
+  const uint32_t seed0 = static_cast<uint32_t>(seed_);
+  const uint32_t seed1 = static_cast<uint32_t>(seed_ >> 32);
+  const unsigned int w = 2 * (draw % 2);
+  for ( size_t first = 0 ; first < n ; first += PHILOX_LANES )
+  {
+    const size_t lanes = n - first < PHILOX_LANES ? n - first : PHILOX_LANES;
+    uint32_t c0[PHILOX_LANES], c1[PHILOX_LANES], c2[PHILOX_LANES], c3[PHILOX_LANES];
+    for ( size_t i = 0 ; i < PHILOX_LANES ; ++i )
+    {
+      c0[i] = draw / 2;
+      c1[i] = i < lanes ? entities[first + i] : 0;
+      c2[i] = year_;
+      c3[i] = phase;
+    }
+    uint32_t k0 = seed0;
+    uint32_t k1 = seed1;
+    for ( int round = 0 ; round < 10 ; ++round )
+    {
+      for ( size_t i = 0 ; i < PHILOX_LANES ; ++i )
+      {
+        const uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * c0[i];
+        const uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * c2[i];
+        const uint32_t x1 = c1[i];
+        const uint32_t x3 = c3[i];
+        c0[i] = static_cast<uint32_t>(p1 >> 32) ^ x1 ^ k0;
+        c1[i] = static_cast<uint32_t>(p1);
+        c2[i] = static_cast<uint32_t>(p0 >> 32) ^ x3 ^ k1;
+        c3[i] = static_cast<uint32_t>(p0);
+      }
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+    for ( size_t i = 0 ; i < lanes ; ++i )
+    {
+      const uint64_t hi = (w ? c2[i] : c0[i]) >> 5;
+      const uint64_t lo = (w ? c3[i] : c1[i]) >> 6;
+      u[first + i] = ((hi << 26) | lo) * (1.0 / 9007199254740992.0);
+    }
+  }
+}
+
+std::ostream& toolbox::RandomGenerator::write(std::ostream &os) const
+{
+  os.write(reinterpret_cast<const char*>(&seed_), sizeof(seed_));
+  os.write(reinterpret_cast<const char*>(&year_), sizeof(year_));
+  return os;
+}
+
+std::istream& toolbox::RandomGenerator::read(std::istream &is)
+{
+  is.read(reinterpret_cast<char*>(&seed_), sizeof(seed_));
+  is.read(reinterpret_cast<char*>(&year_), sizeof(year_));
+  return is;
 }